@@ -0,0 +1,311 @@
+// Throughput and latency benchmarks for node-hdfs.
+//
+//   node bench/bench.js [--host=default] [--port=0] [--dir=/tmp/node-hdfs-bench]
+//                       [--size=64] [--ops=2000] [--concurrency=16]
+//                       [--fanout=8] [--depth=3] [--files=10] [--seconds=5]
+//                       [--only=stat,read-seq,...] [--quick]
+//
+// Runs against whatever the addon is linked with: a cluster through
+// libhdfs, or the local stand-in (node-waf configure --hdfs-local build),
+// whose latency and bandwidth are set with the HDFS_LOCAL_* environment
+// variables described in src/hdfs_local.c. Each result is printed to stdout
+// as one JSON object per line, so runs can be compared by a script; a
+// readable summary goes to stderr.
+
+var HDFS = require('../node-hdfs');
+
+var args = {};
+process.argv.slice(2).forEach(function(arg) {
+  var match = arg.match(/^--([^=]+)(?:=(.*))?$/);
+  if(match) args[match[1]] = match[2] === undefined ? true : match[2];
+});
+
+var KB = 1024, MB = 1024 * 1024;
+var O_RDONLY = 0;
+var quick = !!args.quick;
+var dir = args.dir || "/tmp/node-hdfs-bench";
+var fileSize = (parseFloat(args.size) || (quick ? 8 : 64)) * MB;
+var opCount = parseInt(args.ops) || (quick ? 200 : 2000);
+var concurrency = parseInt(args.concurrency) || 16;
+var chunkSizes = quick ? [64 * KB, 1 * MB] : [64 * KB, 1 * MB, 4 * MB];
+var only = args.only ? args.only.split(",") : null;
+
+var client = new HDFS({host: args.host || "default", port: parseInt(args.port) || 0});
+
+var report = function(result) {
+  result.time = Date.now();
+  console.log(JSON.stringify(result));
+
+  var summary = [result.bench];
+  if(result.chunkSize) summary.push((result.chunkSize / KB) + " KB chunks");
+  if(result.mbPerSec !== undefined) summary.push(result.mbPerSec.toFixed(1) + " MB/s");
+  if(result.opsPerSec !== undefined) summary.push(result.opsPerSec.toFixed(0) + " ops/s");
+  if(result.ms !== undefined) summary.push(result.ms.toFixed(1) + " ms");
+  if(result.maxLagMs !== undefined) summary.push("lag max " + result.maxLagMs.toFixed(1) + " ms, mean " + result.meanLagMs.toFixed(2) + " ms");
+  if(result.errors) summary.push(result.errors + " errors");
+  process.stderr.write(summary.join(", ") + "\n");
+}
+
+var series = function(steps, cb) {
+  var next = function(i) {
+    if(i == steps.length) return cb();
+    steps[i](function(err) {
+      if(err) return cb(err);
+      next(i + 1);
+    });
+  };
+  next(0);
+}
+
+// calls op(i, done) count times, or until the deadline (ms since epoch)
+// when there is one, `parallel` at a time; cb(errors, seconds, count)
+var runOps = function(count, parallel, op, cb, deadline) {
+  var started = Date.now(), issued = 0, completed = 0, errors = 0;
+  var more = function() {
+    return issued < count && !(deadline && Date.now() >= deadline);
+  };
+  var issue = function() {
+    op(issued++, function(err) {
+      if(err) errors++;
+      completed++;
+      if(more()) return issue();
+      if(completed == issued) cb(errors, (Date.now() - started) / 1000, completed);
+    });
+  };
+  if(!more()) return cb(0, 0, 0);
+  for(var i = 0; i < parallel && more(); i++) issue();
+}
+
+var filePath = function(chunkSize) {
+  return dir + "/seq-" + chunkSize;
+}
+
+var writeFile = function(path, size, chunkSize, cb) {
+  var chunk = new Buffer(chunkSize);
+  for(var i = 0; i < chunkSize; i++) chunk[i] = i & 0xff;
+
+  client.write(path, function(writter) {
+    var written = 0;
+    var pump = function() {
+      while(written < size) {
+        var length = Math.min(chunkSize, size - written);
+        written += length;
+        if(!writter.write(length == chunkSize ? chunk : chunk.slice(0, length))) return;
+      }
+      writter.end();
+    };
+    writter.on("drain", pump);
+    writter.once("open", function(err) {
+      err ? cb(err) : pump();
+    });
+    writter.once("close", function(err) {
+      cb(err);
+    });
+  });
+}
+
+var benchmarks = {};
+
+benchmarks["connect"] = function(cb) {
+  var started = Date.now();
+  client.connect(function(err) {
+    report({bench: "connect", ms: Date.now() - started, errors: err ? 1 : 0});
+    if(err) return cb(err);
+    client.mkdir(dir, function(err) { cb(err); });
+  });
+}
+
+benchmarks["write-seq"] = function(cb) {
+  series(chunkSizes.map(function(chunkSize) {
+    return function(done) {
+      var started = Date.now();
+      writeFile(filePath(chunkSize), fileSize, chunkSize, function(err) {
+        var seconds = (Date.now() - started) / 1000;
+        report({bench: "write-seq", chunkSize: chunkSize, bytes: fileSize, seconds: seconds,
+                mbPerSec: fileSize / MB / seconds, errors: err ? 1 : 0});
+        done();
+      });
+    };
+  }), cb);
+}
+
+// the files written by write-seq, or written now when it was skipped
+var ensureFile = function(chunkSize, cb) {
+  client.stat(filePath(chunkSize), function(err, stat) {
+    if(!err && stat.size == fileSize) return cb();
+    writeFile(filePath(chunkSize), fileSize, chunkSize, cb);
+  });
+}
+
+benchmarks["read-seq"] = function(cb) {
+  series(chunkSizes.map(function(chunkSize) {
+    return function(done) {
+      ensureFile(chunkSize, function(err) {
+        if(err) return done(err);
+        var started = Date.now(), bytes = 0;
+        client.read(filePath(chunkSize), {bufferSize: chunkSize, highWaterMark: 4 * chunkSize}, function(reader) {
+          reader.on("data", function(data) { bytes += data.length; });
+          reader.on("end", function(err) {
+            var seconds = (Date.now() - started) / 1000;
+            report({bench: "read-seq", chunkSize: chunkSize, bytes: bytes, seconds: seconds,
+                    mbPerSec: bytes / MB / seconds, errors: err ? 1 : 0});
+            done();
+          });
+        });
+      });
+    };
+  }), cb);
+}
+
+// readInto at random chunk-aligned offsets, `concurrency` reads in flight
+var randomReads = function(path, chunkSize, count, cb, deadline) {
+  client.open(path, O_RDONLY, function(err, handle) {
+    if(err) return cb(err);
+    var chunks = Math.max(Math.floor(fileSize / chunkSize), 1);
+    var buffers = [];
+    for(var i = 0; i < concurrency; i++) buffers.push(new Buffer(chunkSize));
+
+    runOps(count, concurrency, function(i, done) {
+      var offset = Math.floor(Math.random() * chunks) * chunkSize;
+      client.readInto(handle, offset, buffers[i % concurrency], 0, chunkSize, function(err) { done(err); });
+    }, function(errors, seconds, done) {
+      client.close(handle, function() { cb(null, errors, seconds, done); });
+    }, deadline);
+  });
+}
+
+benchmarks["read-random"] = function(cb) {
+  series(chunkSizes.map(function(chunkSize) {
+    return function(done) {
+      ensureFile(chunkSize, function(err) {
+        if(err) return done(err);
+        var count = Math.max(Math.min(opCount, Math.floor(4 * fileSize / chunkSize)), concurrency);
+        randomReads(filePath(chunkSize), chunkSize, count, function(err, errors, seconds) {
+          if(err) return done(err);
+          report({bench: "read-random", chunkSize: chunkSize, ops: count, bytes: count * chunkSize, seconds: seconds,
+                   opsPerSec: count / seconds, mbPerSec: count * chunkSize / MB / seconds, errors: errors});
+          done();
+        });
+      });
+    };
+  }), cb);
+}
+
+var opsBenchmark = function(name, op) {
+  return function(cb) {
+    ensureFile(chunkSizes[0], function(err) {
+      if(err) return cb(err);
+      runOps(opCount, concurrency, op, function(errors, seconds) {
+        report({bench: name, ops: opCount, concurrency: concurrency, seconds: seconds,
+                opsPerSec: opCount / seconds, errors: errors});
+        cb();
+      });
+    });
+  };
+}
+
+benchmarks["stat"] = opsBenchmark("stat", function(i, done) {
+  client.stat(filePath(chunkSizes[0]), function(err) { done(err); });
+});
+
+benchmarks["open"] = opsBenchmark("open", function(i, done) {
+  client.open(filePath(chunkSizes[0]), O_RDONLY, function(err, handle) {
+    if(err) return done(err);
+    client.close(handle, function() { done(); });
+  });
+});
+
+benchmarks["list"] = opsBenchmark("list", function(i, done) {
+  client.list(dir, function(err) { done(err); });
+});
+
+// synthetic tree of `fanout` directories per level, `depth` levels deep and
+// `files` empty files per directory, then listed recursively
+benchmarks["list-recursive"] = function(cb) {
+  var fanout = parseInt(args.fanout) || (quick ? 4 : 8);
+  var depth = parseInt(args.depth) || 3;
+  var files = parseInt(args.files) || (quick ? 4 : 10);
+  var root = dir + "/tree-" + fanout + "-" + depth;
+
+  var dirs = [root], level = [root];
+  for(var d = 0; d < depth; d++) {
+    var next = [];
+    level.forEach(function(parent) {
+      for(var i = 0; i < fanout; i++) next.push(parent + "/d" + i);
+    });
+    dirs = dirs.concat(next);
+    level = next;
+  }
+  var paths = [];
+  dirs.forEach(function(parent) {
+    for(var i = 0; i < files; i++) paths.push(parent + "/f" + i);
+  });
+
+  var create = function(done) {
+    client.exists(root, function(err, exists) {
+      if(exists) return done();
+      client.mkdirMany(dirs, function(err) {
+        if(err) return done(err);
+        runOps(paths.length, concurrency, function(i, opDone) {
+          client.write(paths[i], function(writter) {
+            writter.once("close", function(err) { opDone(err); });
+            writter.once("open", function(err) { err ? opDone(err) : writter.end(); });
+          });
+        }, function(errors) {
+          done(errors ? "Could not create the tree" : null);
+        });
+      });
+    });
+  };
+
+  create(function(err) {
+    if(err) return cb(err);
+    var started = Date.now();
+    client.list(root, {recursive: true, compact: true}, function(err, entries) {
+      report({bench: "list-recursive", fanout: fanout, depth: depth, filesPerDir: files,
+               entries: entries ? entries.length : 0, ms: Date.now() - started, errors: err ? 1 : 0});
+      cb();
+    });
+  });
+}
+
+// how late a 10 ms timer fires while random reads keep the workers busy
+// for --seconds (default 5)
+benchmarks["loop-lag"] = function(cb) {
+  var chunkSize = chunkSizes[chunkSizes.length - 1];
+  ensureFile(chunkSize, function(err) {
+    if(err) return cb(err);
+    var interval = 10, samples = 0, totalLag = 0, maxLag = 0, last = Date.now();
+    var timer = setInterval(function() {
+      var now = Date.now(), lag = Math.max(now - last - interval, 0);
+      last = now;
+      samples++;
+      totalLag += lag;
+      if(lag > maxLag) maxLag = lag;
+    }, interval);
+
+    var duration = (parseFloat(args.seconds) || (quick ? 1 : 5)) * 1000;
+    randomReads(filePath(chunkSize), chunkSize, Infinity, function(err, errors, seconds, count) {
+      clearInterval(timer);
+      if(err) return cb(err);
+      report({bench: "loop-lag", chunkSize: chunkSize, ops: count, seconds: seconds,
+              mbPerSec: count * chunkSize / MB / seconds, samples: samples,
+              maxLagMs: maxLag, meanLagMs: samples ? totalLag / samples : 0, errors: errors});
+      cb();
+    }, Date.now() + duration);
+  });
+}
+
+var order = ["connect", "write-seq", "read-seq", "read-random", "stat", "open", "list", "list-recursive", "loop-lag"];
+
+HDFS.resetStats();
+series(order.filter(function(name) {
+  return name == "connect" || !only || only.indexOf(name) >= 0;
+}).map(function(name) {
+  return benchmarks[name];
+}), function(err) {
+  report({bench: "opStats", stats: HDFS.stats(), workers: HDFS.workerStats(), errors: err ? 1 : 0});
+  if(err) process.stderr.write("Benchmark failed: " + err + "\n");
+  client.disconnect();
+  process.exit(err ? 1 : 0);
+});
@@ -1,11 +1,18 @@
 var sys          = require('sys')
   , fs           = require('fs')
   , EventEmitter = require('events').EventEmitter
+  , Stream       = require('stream').Stream
   , HDFSBindings = require('./hdfs_bindings')
-  , url          = require('url')
 
-var HDFS = new HDFSBindings.Hdfs();
+// native clients shared by every pooled HDFS instance of the same
+// host:port:user, with the number of those instances currently connected
+var sharedBindings = {};
 
+// client I/O buffer used by the streaming reader and writer unless told otherwise
+var STREAM_IO_BUFFER_SIZE = 1024*1024;
+
+// bytes a writer accepts ahead of the native writes before write() returns false
+var WRITE_HIGH_WATER_MARK = 4*1024*1024;
 
 var modes = {
   O_RDONLY : 0x0000,
@@ -16,22 +23,104 @@ var modes = {
   O_TRUNC  : 0x0400
 }
 
+// options: {host, port, user, pool, idleTimeout, metadataCache, readCache}
+// Each instance owns its native client (and hdfsFS handle) unless `pool` is
+// set: pooled instances share one native client per host:port:user that
+// spreads operations over up to `pool` connections, closing extra ones
+// after idleTimeout ms without use. metadataCache: {ttl, maxEntries} caches
+// stat/exists/list results natively, see configureMetadataCache; readCache:
+// {size, pageSize} caches file pages, see configureReadCache.
 module.exports = function(options) {
   this.host = options.host || "default";
   this.port = options.port || 0;
+  this.user = options.user;
+  this.pool = options.pool || 0;
   this.connected = false;
+  EventEmitter.call(this);
 
   var self = this;
+  var shared = null;
+  var HDFS;
+
+  if(this.pool) {
+    var key = [this.host, this.port, this.user || ""].join(":");
+    shared = sharedBindings[key] = sharedBindings[key] || {key: key, bindings: new HDFSBindings.Hdfs(), clients: 0};
+    HDFS = shared.bindings;
+  } else {
+    HDFS = new HDFSBindings.Hdfs();
+  }
 
-  this.connect = function() {
-    if(!this.connected) {
-      HDFS.connect(self.host, self.port);
-      this.connected = true;
+  // connection state of the native client, shared with the other pooled
+  // instances when there is a pool
+  var link = shared || {clients: 0};
+
+  if(options.metadataCache) HDFS.configureCache(options.metadataCache);
+  if(options.readCache) HDFS.configureReadCache(options.readCache);
+
+  // The connection is opened on a worker thread, so this never blocks the
+  // event loop. Every operation connects implicitly; the ones issued before
+  // the connection is up wait for it on the worker threads. cb(err, stats)
+  // and the "connect" event follow once it is up, see connectStats().
+  this.connect = function(cb) {
+    if(!self.connected) {
+      self.connected = true;
+      if(link.clients++ == 0) {
+        link.ready = false;
+        link.waiting = [];
+        HDFS.connect(self.host, self.port, self.user || "", {poolSize: self.pool || 1, idleTimeout: options.idleTimeout || 60000}, function(err, stats) {
+          var waiting = link.waiting;
+          link.ready = true;
+          link.err = err || null;
+          link.waiting = [];
+          waiting.forEach(function(fn) { fn(link.err, stats); });
+        });
+      }
+      onConnect(function(err, stats) { self.emit("connect", err, stats); });
     }
+    if(cb) onConnect(cb);
+  }
+
+  var onConnect = function(fn) {
+    if(!link.ready) return link.waiting.push(fn);
+    process.nextTick(function() { fn(link.err, HDFS.connectStats()); });
+  }
+
+  // {connects, failures, lastMs, maxMs, totalMs, jvmStartMs, connected}
+  this.connectStats = function() {
+    return HDFS.connectStats();
+  }
+
+  // options: {ttl (ms, 0 disables), maxEntries (default 10000)}
+  // Cached results are dropped for paths changed through this client (and
+  // the clients sharing its pool); other writers are seen once ttl expires.
+  this.configureMetadataCache = function(options) {
+    HDFS.configureCache(options || {});
+  }
+
+  // {hits, misses, evictions, invalidations, entries}
+  this.metadataCacheStats = function() {
+    return HDFS.cacheStats();
+  }
+
+  // options: {size (bytes, 0 disables), pageSize (default 64 KB)}
+  // Only files opened with {cache: true} are read through it, in aligned
+  // pages; writes through this client invalidate the file's pages.
+  this.configureReadCache = function(options) {
+    HDFS.configureReadCache(options || {});
+  }
+
+  // {hits, misses, coalesced, evictions, bytes, pages, pageSize, size}
+  this.readCacheStats = function() {
+    return HDFS.readCacheStats();
   }
 
   this.disconnect = function() {
-    HDFS.disconnect();
+    if(!this.connected) return;
+    if(--link.clients == 0) {
+      HDFS.disconnect();
+      link.ready = false;
+      if(shared) delete sharedBindings[shared.key];
+    }
     this.connected = false;
   }
 
@@ -46,42 +135,129 @@ module.exports = function(options) {
     });
   }
 
-  this.stat = function(path, cb) {
+  // options: {compact} - see CompactFileList
+  this.stat = function(path, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
     self.connect();
-    HDFS.stat(path, cb);
+    HDFS.stat(path, options || {}, compactResult(cb));
   }
 
+  // options: {recursive, compact}
   this.list = function(path, options, cb) {
     if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
     self.connect();
 
-    var pending = 0;
-
-    HDFS.list(path,function(err, files) {
-      if(!err) {
-        if(!(options && options.recursive)) return cb(err, files); // not recursive
-        for(i in files) {
-          if(files[i].type == "directory") {
-            var newPath = url.parse(files[i].path).pathname;
-            pending++;
-            self.list(newPath, options, function(newErr, newFiles) {
-              if(newErr) {
-                if(--pending == 0) cb(err, files);
-              } else {
-                files = files.concat(newFiles);
-                if(--pending == 0) cb(err, files);
-              }
-            });
-          }
-        }
-      }
-      if(pending == 0) cb(err, files);
+    if(options.recursive) {
+      HDFS.walk(path, {compact: options.compact}, compactResult(function(err, files) { cb(err, files); }));
+    } else {
+      HDFS.list(path, options, compactResult(cb));
+    }
+  }
+
+  // Batched variants, run natively with options.parallel (default 8) chunks
+  // of paths in flight. Results come back in the order of the paths.
+
+  // cb(err, [true|false, ...])
+  this.existsMany = function(paths, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    HDFS.batch("exists", paths, options || {}, function(err, results) {
+      cb(err || null, results && results.map(function(result) { return result == 0; }));
     });
   }
 
-  this.open = function(path, mode, cb) {
+  // cb(err, [stat|null, ...]), null for paths that do not exist
+  this.statMany = function(paths, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
     self.connect();
-    HDFS.open(path, mode, cb);
+    HDFS.batch("stat", paths, options || {}, function(err, results) { cb(err || null, results); });
+  }
+
+  // cb(errors, [true|false, ...]), errors is null or maps failed paths to a message
+  this.mkdirMany = function(paths, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    HDFS.batch("mkdir", paths, options || {}, function(err, results) {
+      batchResult(paths, results, function(result) { return result == 0 ? null : "Error creating directory"; }, cb);
+    });
+  }
+
+  // options: {recursive, force, parallel} - same checks as rm, per path
+  this.rmMany = function(paths, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {recursive:false, force:false}
+    self.connect();
+
+    var refused = {}, allowed = [];
+    paths.forEach(function(path) {
+      var err = checkDeletePath(path, options);
+      err ? refused[path] = err : allowed.push(path);
+    });
+
+    var op = (options.recursive || options.force) ? "rm" : "rmEmpty";
+    HDFS.batch(op, allowed, options, function(err, results) {
+      var byPath = {};
+      allowed.forEach(function(path, i) { byPath[path] = results[i]; });
+      batchResult(paths, paths.map(function(path) { return refused[path] || byPath[path]; }), function(result) {
+        return typeof result == "string" ? result : deleteError(result);
+      }, cb);
+    });
+  }
+
+  // Recursive listing done natively, off the event loop.
+  // options: {depth, parallel, pageSize, match (glob on the entry name),
+  //           type: "file"|"directory", minSize, maxSize, modifiedSince, compact}
+  // cb(err, files, done) is called once, or once per page of pageSize entries.
+  this.walk = function(path, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    HDFS.walk(path, options || {}, compactResult(cb));
+  }
+
+  // cb(err, [{offset, length, hosts}, ...]) for the blocks overlapping the range;
+  // length <= 0 means up to the end of the file
+  this.blockLocations = function(path, offset, length, cb) {
+    self.connect();
+    HDFS.blockLocations(path, offset || 0, length || 0, cb);
+  }
+
+  // Plans per-block read tasks over a set of files for workers running on
+  // DataNodes, so that each block is read where a replica lives (a local,
+  // short-circuit read) and the bytes are spread evenly. options: {workers:
+  // [host, ...] (default: every host holding a replica), parallel (default 8
+  // blockLocations calls at a time), taskSize (split blocks in tasks of at
+  // most that many bytes)}. cb(errors by path or null, plan) - see planBlockReads.
+  this.planReads = function(paths, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+    var parallel = Math.max(options.parallel || 8, 1);
+    var blocks = [], errors = null, next = 0, done = 0;
+
+    var locate = function() {
+      if(next >= paths.length) return;
+      var path = paths[next++];
+      self.blockLocations(path, 0, 0, function(err, locations) {
+        if(err) {
+          (errors = errors || {})[path] = err;
+        } else {
+          locations.forEach(function(block) {
+            blocks.push({path: path, offset: block.offset, length: block.length, hosts: block.hosts});
+          });
+        }
+        if(++done == paths.length) return cb(errors, planBlockReads(blocks, options));
+        locate();
+      });
+    };
+
+    if(paths.length == 0) return process.nextTick(function() { cb(null, planBlockReads([], options)); });
+    for(var i = 0; i < parallel; i++) locate();
+  }
+
+  this.open = function(path, mode, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    options ? HDFS.open(path, mode, options, cb) : HDFS.open(path, mode, cb);
   }
 
   this.close = function(handle, cb) {
@@ -89,94 +265,116 @@ module.exports = function(options) {
     HDFS.close(handle, cb);
   }
 
-  this.read = function(path, bufferSize, cb) {
-    if (!cb && typeof bufferSize == "function") { cb = bufferSize; bufferSize = undefined; }
+  this.fileStats = function(handle) {
+    return HDFS.fileStats(handle);
+  }
+
+  this.seek = function(handle, offset, cb) {
+    self.connect();
+    HDFS.seek(handle, offset, cb);
+  }
+
+  this.tell = function(handle, cb) {
     self.connect();
-    var reader = new HDFSReader(path, bufferSize);
+    HDFS.tell(handle, cb);
+  }
+
+  this.flush = function(handle, cb) {
+    self.connect();
+    HDFS.flush(handle, cb);
+  }
+
+  this.sync = function(handle, cb) {
+    self.connect();
+    HDFS.sync(handle, cb);
+  }
+
+  this.readInto = function(handle, offset, buffer, bufferOffset, length, cb) {
+    self.connect();
+    HDFS.readInto(handle, offset, buffer, bufferOffset, length, cb);
+  }
+
+  // Reads many [offset, length] ranges in one call; nearby ranges are merged
+  // (options.gap, default 64 KB) and read options.parallel (default 4) at a
+  // time. cb(err, buffers) gets one slice of a shared Buffer per range, in
+  // order; a slice is short at the end of the file.
+  this.readv = function(handle, ranges, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    HDFS.readv(handle, ranges, options || {}, function(err, buffer, positions) {
+      if(err) return cb(err);
+      cb(null, positions.map(function(position) {
+        return buffer.slice(position[0], position[0] + position[1]);
+      }));
+    });
+  }
+
+  // Splits a file into records on the worker threads: options as in read()
+  // plus delimiter (default "\n", a "\r" before it is dropped too),
+  // recordLength for fixed-length records, and start/end for a split with
+  // Hadoop TextInputFormat semantics. Emits "records" with RecordBatch
+  // objects, then "end".
+  this.readRecords = function(path, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    var reader = new HDFSRecordReader(HDFS, path, options);
+    return cb ? cb(reader) : reader;
+  }
+
+  // options may be a bufferSize number or {bufferSize, pool, start, prefetch} plus any open() options;
+  // bufferSize is both the chunk size and the client I/O buffer size; start
+  // cannot be combined with a codec
+  this.read = function(path, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    var reader = new HDFSReader(HDFS, path, options);
     return cb ? cb(reader) : reader;
   }
 
-  this.write = function(path, mode, cb) {
+  // write(path, [mode], [options], [cb]) - options as in open()
+  this.write = function(path, mode, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
     if (!cb && typeof mode == "function") { cb = mode; mode = undefined; }
+    if (typeof mode == "object") { options = mode; mode = undefined; }
     mode = mode || (modes.O_WRONLY | modes.O_CREAT)
     self.connect();
-    var writter = new HDFSWritter(path, mode);
+    var writter = new HDFSWritter(HDFS, path, mode, options);
     return cb ? cb(writter) : writter;
   }
 
-  this.append = function(path, cb) {
-    return self.write(path, modes.O_WRONLY | modes.O_APPEND, cb)
+  this.append = function(path, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    return self.write(path, modes.O_WRONLY | modes.O_APPEND, options, cb)
   }
 
   this.mkdir = function(path,cb) {
     self.connect();
-    self.exists(path, function(result) {
-      if(result != 0) {
-        HDFS.mkdir(path,function(result) {
-          if(result == 0) {
-            cb(null, true);
-          } else {
-            cb("Error creating directory", false);  // generic error :p
-          }
-        });
-      } else {
+    HDFS.mkdir(path,function(result) {
+      if(result == 0) {
+        cb(null, true);
+      } else if(result == 1) {
         cb("File or directory already exists", false);
+      } else {
+        cb("Error creating directory", false);  // generic error :p
       }
-    })
+    });
   }
 
+  // Without recursive or force, non-empty directories are refused. The
+  // existence and emptiness checks are done natively with the delete itself.
   this.rm = function(path,options, cb) {
     if (!cb && typeof options == "function") { cb = options; options = undefined; }
     options = options || {recursive:false, force:false}
     self.connect();
 
-    if(!options.force) {
-      var slashes = path.split("/");
-      if(slashes[0] != "") {
-        return(cb("cowardly refusing to delete relative path - set force to true in options to override", false));
-      }
-      if( slashes.length < 3 || (slashes.length == 3 && slashes[2] == "")) {
-        return(cb("cowardly refusing to delete root folder or first-level folder - set force to true in options to override", false));
-      }
-    }
+    var err = checkDeletePath(path, options);
+    if(err) return(cb(err, false));
 
-    var delete_file = function() {
-      HDFS.rm(path,function(result) {
-        if(result == 0) {
-          cb(null, true);
-        } else {
-          cb("Error deleting file", false);  // generic error :p
-        }
-      });
-    }
-
-    self.exists(path, function(err, result) {
-      if(!err && result) {
-        if(!options.recursive && !options.force) {
-          self.stat(path, function(err, data) {
-            if(err) {
-              cb("failed stating the path or file", false);
-            } else {
-              if(data.type == "directory") {
-                self.list(path, function(err, files) {
-                  if(files && files.length > 0) {
-                    cb("directory is not empty -- use recursive:true in options to force deletion", false);
-                  } else { // directory empty
-                    delete_file();
-                  }
-                });
-              } else { // not a directory
-                delete_file();
-              }
-            }
-          });
-        } else {  // recursive or force set
-          delete_file();
-        }
-      } else {
-        cb("File or directory does not exists", false);
-      }
-    })
+    var op = (options.recursive || options.force) ? "rm" : "rmEmpty";
+    HDFS.batch(op, [path], function(err, results) {
+      err = deleteError(results[0]);
+      cb(err, !err);
+    });
   }
 
   // same as rm, but ensure path is a directory
@@ -194,20 +392,131 @@ module.exports = function(options) {
     })
   }
 
+  // A rename only touches the NameNode, no data is copied. As in HDFS it
+  // does not overwrite dst, and moves src into dst when dst is a directory.
+  this.rename = function(src, dst, cb) {
+    self.connect();
+    HDFS.batch("rename", [[src, dst]], function(err, results) {
+      err = renameError(results[0]);
+      cb(err, !err);
+    });
+  }
+
+  // pairs: [[src, dst], ...], renamed natively options.parallel (default 8)
+  // chunks at a time; errors are keyed by src
+  this.renameMany = function(pairs, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    self.connect();
+    HDFS.batch("rename", pairs, options || {}, function(err, results) {
+      batchResult(pairs.map(function(pair) { return pair[0]; }), results, renameError, cb);
+    });
+  }
+
+  // the native client, for operations between two clients
+  this.bindings = function() {
+    self.connect();
+    return HDFS;
+  }
+
+  // Copies a file or directory to dst on this filesystem or, with options.to,
+  // on another client's (another cluster, or the local filesystem). libhdfs
+  // streams the data on a worker thread without handing it to JS; HDFS has
+  // no server-side copy, so every byte still goes through this process.
+  this.copy = function(src, dst, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+    self.connect();
+    HDFS.copy(src, options.to && options.to !== self ? options.to.bindings() : null, dst, function(err) {
+      cb(err, !err);
+    });
+  }
+
+  // Within a filesystem a move is a rename; to another client (options.to)
+  // the data is copied and src deleted afterwards.
+  this.move = function(src, dst, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+    if(!options.to || options.to === self) return self.rename(src, dst, cb);
+    self.connect();
+    HDFS.move(src, options.to.bindings(), dst, function(err) {
+      cb(err, !err);
+    });
+  }
+
+  // Publishes the output staged in a directory with renames only: every
+  // entry of staging but the hidden ones ("_" or "." prefixed, such as
+  // _temporary) is renamed into target, created if needed, options.parallel
+  // (default 8) chunks at a time. If a rename fails, those already done are
+  // renamed back, so target gets either all of the new files or none of
+  // them. Then an empty _SUCCESS marker is written (unless options.success
+  // is false) and staging is removed (unless options.cleanup is false).
+  // cb(err, committedPaths)
+  this.commitDirectory = function(staging, target, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+
+    var listStaging = function(next) {
+      self.list(staging, function(err, entries) {
+        if(!err) return next(null, entries);
+        // an empty directory lists as an error too
+        self.exists(staging, function(missing) { next(missing ? err : null, []); });
+      });
+    };
+
+    var finish = function(committed) {
+      var cleanup = function() {
+        if(options.cleanup === false) return cb(null, committed);
+        // forced: staging may be a first-level or relative path, which rm
+        // refuses otherwise, and the output is already published
+        self.rm(staging, {recursive: true, force: true}, function(err) { cb(err, committed); });
+      };
+      if(options.success === false) return cleanup();
+      self.write(target + "/_SUCCESS", function(writter) {
+        writter.once("open", function(err) { err ? cb(err, committed) : writter.end(); });
+        writter.once("close", function(err) { err ? cb(err, committed) : cleanup(); });
+      });
+    };
+
+    listStaging(function(err, entries) {
+      if(err) return cb(err);
+      var pairs = [];
+      entries.forEach(function(entry) {
+        var name = entry.path.replace(/\/+$/, "").split("/").pop();
+        if(name.charAt(0) != "_" && name.charAt(0) != ".") pairs.push([entry.path, target + "/" + name]);
+      });
+
+      // committing into an existing directory is fine
+      self.mkdir(target, function(err) {
+        if(err && err != "File or directory already exists") return cb(err);
+        self.renameMany(pairs, options, function(errors, ok) {
+          var committed = pairs.filter(function(pair, i) { return ok[i]; });
+          if(!errors) return finish(committed.map(function(pair) { return pair[1]; }));
+
+          self.renameMany(committed.map(function(pair) { return [pair[1], pair[0]]; }), options, function(rollbackErrors) {
+            cb(rollbackErrors ? {renames: errors, rollback: rollbackErrors} : errors, []);
+          });
+        });
+      });
+    });
+  }
+
   this.copyToLocalPath = function(srcPath, dstPath, options, cb) {
     if (!cb && typeof options == "function") { cb = options; options = undefined; }
     options = options || {encoding: null, mode:0666};
     options.flags = 'w'; // force mode
 
+    if(options.parallel > 1) return copyToLocalPathParallel(srcPath, dstPath, options, cb);
+
     var stream = fs.createWriteStream(dstPath, options);
 
     stream.once('open', function(fd) {
       self.read(srcPath, function(rh) {
         var readed = 0;
         rh.on('data', function(data) {
-          stream.write(data);
+          if(!stream.write(data)) rh.pause();
           readed += data.length;
         });
+        stream.on('drain', function() { rh.resume(); });
         rh.once('end', function(err) {
           stream.end();
           cb(err, readed);
@@ -216,48 +525,578 @@ module.exports = function(options) {
     });
   }
 
+  // Splits the file into block-aligned ranges and reads them concurrently
+  // (one HDFS handle per worker), writing each chunk at its own position in
+  // a preallocated local file.
+  var copyToLocalPathParallel = function(srcPath, dstPath, options, cb) {
+    var bufferSize = options.bufferSize || 4*1024*1024;
+
+    self.stat(srcPath, function(err, info) {
+      if(err) return cb(err, 0);
+      self.blockLocations(srcPath, 0, info.size, function(err, blocks) {
+        var ranges = [];
+        if(!err && blocks.length > 0) {
+          blocks.forEach(function(block) { ranges.push({start: block.offset, end: block.offset + block.length}); });
+        } else {
+          var blockSize = info.block_size || 64*1024*1024;
+          for(var offset = 0; offset < info.size; offset += blockSize) {
+            ranges.push({start: offset, end: Math.min(offset + blockSize, info.size)});
+          }
+        }
+        ranges = splitRanges(ranges, options.parallel, bufferSize);
+
+        fs.open(dstPath, 'w', options.mode || 0666, function(err, fd) {
+          if(err) return cb(err, 0);
+          fs.truncate(fd, info.size, function(err) {
+            if(err) return fs.close(fd, function() { cb(err, 0); });
+
+            var workers = Math.min(options.parallel, ranges.length);
+            var readed = 0, failure = null;
+            var workerDone = function(err) {
+              failure = failure || err;
+              if(--workers == 0) {
+                fs.close(fd, function(closeErr) { cb(failure || closeErr, readed); });
+              }
+            };
+            if(workers == 0) { workers = 1; return workerDone(); }
+
+            for(var i = 0; i < workers; i++) {
+              copyRanges(srcPath, fd, ranges, bufferSize, function(len) { readed += len; }, function() { return failure; }, workerDone);
+            }
+          });
+        });
+      });
+    });
+  }
+
+  // splits ranges further (on bufferSize boundaries) until there is at
+  // least one per worker
+  var splitRanges = function(ranges, workers, bufferSize) {
+    if(ranges.length == 0 || ranges.length >= workers) return ranges;
+    var pieces = Math.ceil(workers / ranges.length);
+    var result = [];
+    ranges.forEach(function(range) {
+      var step = Math.ceil((range.end - range.start) / pieces / bufferSize) * bufferSize;
+      for(var start = range.start; start < range.end; start += step) {
+        result.push({start: start, end: Math.min(start + step, range.end)});
+      }
+    });
+    return result;
+  }
+
+  var copyRanges = function(srcPath, fd, ranges, bufferSize, progress, failed, done) {
+    HDFS.open(srcPath, modes.O_RDONLY, {bufferSize: bufferSize}, function(err, handle) {
+      if(err) return done(err);
+      var buffer = new Buffer(bufferSize);
+      var range = null;
+
+      var finish = function(err) {
+        HDFS.close(handle, function() { done(err); });
+      };
+
+      var next = function() {
+        if(failed()) return finish();
+        if(!range || range.start >= range.end) range = ranges.shift();
+        if(!range) return finish();
+
+        var length = Math.min(bufferSize, range.end - range.start);
+        HDFS.readInto(handle, range.start, buffer, 0, length, function(err, readBytes) {
+          if(err || readBytes <= 0) return finish(err || "Unexpected end of file");
+          fs.write(fd, buffer, 0, readBytes, range.start, function(err) {
+            if(err) return finish(err);
+            range.start += readBytes;
+            progress(readBytes);
+            next();
+          });
+        });
+      };
+      next();
+    });
+  }
+
+  // options: {bufferSize (local read chunk), plus any open() options};
+  // the HDFS file is flushed on close only, unless options.flush says otherwise
   this.copyFromLocalPath = function(srcPath, dstPath, options, cb) {
-    if (!cb || typeof cb != "function") {
-      cb = options;
-      options = {bufferSize: 1300, encoding: null, mode:0666, flags: 'r'};
-    }
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+    var bufferSize = options.bufferSize || UPLOAD_CHUNK_SIZE;
+    var writeOptions = {};
+    for(var key in options) if(key != "onWrite") writeOptions[key] = options[key];
+    writeOptions.bufferSize = bufferSize;
+    writeOptions.flush = writeOptions.flush || "never";
+    // one chunk being written plus one queued behind it
+    writeOptions.highWaterMark = writeOptions.highWaterMark || 2*bufferSize;
 
-    self.write(dstPath, function(writter) {
-      var written = 0;
+    self.write(dstPath, writeOptions, function(writter) {
+      var written = 0, stream = null;
       writter.once("open", function(handle) {
-        var stream = fs.createReadStream(srcPath, options);
-        stream.on("data", function(data) { writter.write(data); });
+        stream = fs.createReadStream(srcPath, {bufferSize: bufferSize, highWaterMark: bufferSize, encoding: null, flags: 'r'});
+        stream.on("data", function(data) {
+          if(!writter.write(data)) stream.pause();
+        });
+        writter.on("drain", function() { stream.resume(); });
+        stream.on("error", function(err) { writter.end(err); });
         stream.on("close", function() { writter.end();})
       });
 
-      writter.on("write", function(len) { written += len; });
-      writter.on("close", function(err) { cb(err, written); })
+      writter.on("write", function(len) {
+        written += len;
+        if(options.onWrite) options.onWrite(len);
+      });
+      writter.on("close", function(err) {
+        // after a failed write the rest of the local file is not read
+        if(err && stream) stream.destroy();
+        cb(err, written);
+      })
     })
   }
+
+  // Uploads every file under srcDir (optionally filtered) to the same
+  // relative path under dstDir, with at most options.parallel files in
+  // flight. Returns an EventEmitter that emits "file" (src, dst, bytes),
+  // "progress" ({files, totalFiles, bytes, elapsed, bytesPerSecond}) and
+  // "end" (err, stats); cb receives the same as "end".
+  // options: {parallel, match (glob on the file name, RegExp or function),
+  //           recursive, plus any copyFromLocalPath() options}
+  this.copyFromLocalDir = function(srcDir, dstDir, options, cb) {
+    if (!cb && typeof options == "function") { cb = options; options = undefined; }
+    options = options || {};
+    var parallel = options.parallel || 4;
+    var match = matcher(options.match);
+    var events = new EventEmitter();
+    var start = new Date().getTime();
+    var stats = {files: 0, totalFiles: 0, bytes: 0, elapsed: 0, bytesPerSecond: 0};
+    var failure = null;
+
+    var copyOptions = {};
+    for(var key in options) {
+      if(key != "parallel" && key != "match" && key != "recursive") copyOptions[key] = options[key];
+    }
+    copyOptions.onWrite = function(len) {
+      stats.bytes += len;
+      stats.elapsed = new Date().getTime() - start;
+      stats.bytesPerSecond = stats.elapsed > 0 ? Math.round(stats.bytes * 1000 / stats.elapsed) : 0;
+      events.emit("progress", stats);
+    };
+
+    var finish = function(err) {
+      stats.elapsed = new Date().getTime() - start;
+      events.emit("end", err, stats);
+      if(cb) cb(err, stats);
+    };
+
+    listLocalFiles(srcDir, "", options.recursive !== false, match, function(err, files) {
+      if(err) return finish(err);
+      stats.totalFiles = files.length;
+
+      var running = 0;
+      var next = function() {
+        while(!failure && running < parallel && files.length > 0) {
+          var relative = files.shift();
+          running++;
+          uploadOne(relative);
+        }
+        if(running == 0) finish(failure);
+      };
+
+      var uploadOne = function(relative) {
+        var src = srcDir.replace(/\/$/, "") + "/" + relative;
+        var dst = dstDir.replace(/\/$/, "") + "/" + relative;
+        self.copyFromLocalPath(src, dst, copyOptions, function(err, written) {
+          running--;
+          if(err) {
+            failure = failure || err;
+          } else {
+            stats.files++;
+            events.emit("file", src, dst, written);
+          }
+          next();
+        });
+      };
+
+      next();
+    });
+
+    return events;
+  }
+}
+
+sys.inherits(module.exports, EventEmitter);
+
+// chunk size for local -> HDFS uploads (a multiple of the 64 KB packet size)
+var UPLOAD_CHUNK_SIZE = 4*1024*1024;
+
+// options.match for copyFromLocalDir: glob string, RegExp or predicate on the file name
+var matcher = function(match) {
+  if(!match) return function() { return true; };
+  if(typeof match == "function") return match;
+  if(!(match instanceof RegExp)) {
+    match = new RegExp("^" + match.replace(/[.+^${}()|[\]\\]/g, "\\$&").replace(/\*/g, ".*").replace(/\?/g, ".") + "$");
+  }
+  return function(name) { return match.test(name); };
+}
+
+// cb(err, [relative paths of matching files under root/dir])
+var listLocalFiles = function(root, dir, recursive, match, cb) {
+  var base = dir ? root + "/" + dir : root;
+  fs.readdir(base, function(err, names) {
+    if(err) return cb(err);
+    var files = [], pending = names.length, failed = false;
+    if(pending == 0) return cb(null, files);
+
+    var done = function(err, more) {
+      if(failed) return;
+      if(err) { failed = true; return cb(err); }
+      if(more) files.push.apply(files, more);
+      if(--pending == 0) cb(null, files);
+    };
+
+    names.forEach(function(name) {
+      var relative = dir ? dir + "/" + name : name;
+      fs.stat(root + "/" + relative, function(err, stat) {
+        if(err) return done(err);
+        if(stat.isDirectory()) {
+          recursive ? listLocalFiles(root, relative, recursive, match, done) : done();
+        } else {
+          done(null, match(name) ? [relative] : null);
+        }
+      });
+    });
+  });
+}
+
+var checkDeletePath = function(path, options) {
+  if(options.force) return null;
+  var slashes = path.split("/");
+  if(slashes[0] != "") {
+    return "cowardly refusing to delete relative path - set force to true in options to override";
+  }
+  if( slashes.length < 3 || (slashes.length == 3 && slashes[2] == "")) {
+    return "cowardly refusing to delete root folder or first-level folder - set force to true in options to override";
+  }
+  return null;
+}
+
+// maps the native batch delete result codes
+var deleteError = function(result) {
+  switch(result) {
+    case 0: return null;
+    case 1: return "File or directory does not exists";
+    case 2: return "directory is not empty -- use recursive:true in options to force deletion";
+    default: return "Error deleting file";  // generic error :p
+  }
+}
+
+// maps the native batch rename result codes
+var renameError = function(result) {
+  switch(result) {
+    case 0: return null;
+    case 1: return "Source does not exist";
+    case 3: return "Destination already exists";
+    default: return "Error renaming file";
+  }
+}
+
+var batchResult = function(paths, results, toError, cb) {
+  var errors = null;
+  var ok = results.map(function(result, i) {
+    var err = toError(result);
+    if(err) (errors = errors || {})[paths[i]] = err;
+    return !err;
+  });
+  cb(errors, ok);
+}
+
+var compactResult = function(cb) {
+  return function(err, result, done) {
+    cb(err, result && result.compact ? new CompactFileList(result) : result, done);
+  };
+}
+
+// Assigns blocks ({path, offset, length, hosts}) to hosts: to the least
+// loaded worker holding a replica, or the least loaded worker at all when
+// none does (a remote read). Blocks with the fewest local choices go
+// first so they get them. Returns {tasks, byHost: {host: [task, ...]},
+// localBytes, remoteBytes}, each task being a block (or a taskSize piece of
+// one) with `host` and `local` set.
+var planBlockReads = function(blocks, options) {
+  options = options || {};
+  var workers = options.workers ? options.workers.map(function(host) { return host.toLowerCase(); }) : null;
+  var load = {}, byHost = {}, tasks = [], localBytes = 0, remoteBytes = 0;
+  if(workers) workers.forEach(function(host) { load[host] = 0; byHost[host] = []; });
+
+  var pieces = [];
+  blocks.forEach(function(block) {
+    var size = options.taskSize > 0 ? options.taskSize : block.length || 1;
+    for(var offset = 0; offset < block.length || (offset == 0 && block.length == 0); offset += size) {
+      pieces.push({path: block.path, offset: block.offset + offset, length: Math.min(size, block.length - offset),
+                   hosts: block.hosts.map(function(host) { return host.toLowerCase(); })});
+      if(block.length == 0) break;
+    }
+  });
+
+  var candidates = function(piece) {
+    return workers ? piece.hosts.filter(function(host) { return load[host] !== undefined; }) : piece.hosts;
+  };
+  pieces.sort(function(a, b) {
+    return (candidates(a).length - candidates(b).length) || (b.length - a.length);
+  });
+
+  var leastLoaded = function(hosts) {
+    var best = null;
+    hosts.forEach(function(host) {
+      if(best === null || (load[host] || 0) < (load[best] || 0)) best = host;
+    });
+    return best;
+  };
+
+  pieces.forEach(function(piece) {
+    var local = candidates(piece);
+    var host = leastLoaded(local.length ? local : (workers || []));
+    piece.local = local.length > 0;
+    piece.host = host;
+    if(host !== null) {
+      load[host] = (load[host] || 0) + piece.length;
+      (byHost[host] = byHost[host] || []).push(piece);
+    }
+    piece.local ? localBytes += piece.length : remoteBytes += piece.length;
+    tasks.push(piece);
+  });
+
+  return {tasks: tasks, byHost: byHost, localBytes: localBytes, remoteBytes: remoteBytes};
 }
 
-var HDFSReader = function(path, bufferSize) {
+module.exports.planBlockReads = planBlockReads;
+
+// Listing returned with {compact: true}: numeric fields are kept in
+// Float64Arrays (built per column on first use), paths in a single UTF-8
+// Buffer and owner/group names interned. get(i) builds the usual stat object.
+var COMPACT_COLUMNS = ["kind", "size", "replication", "block_size", "permissions",
+                       "last_mod", "last_access", "owner", "group", "name_start", "name_end"];
+
+var CompactFileList = function(raw) {
+  this.length = raw.length;
+  this.raw = raw;
+  this.columns = {};
+}
+
+CompactFileList.prototype.column = function(name) {
+  var column = this.columns[name];
+  if(!column) {
+    var index = COMPACT_COLUMNS.indexOf(name);
+    if(index < 0) throw new Error("Unknown column " + name);
+    column = this.columns[name] = new Float64Array(this.length);
+    var base = index * this.length * 8;
+    for(var i = 0; i < this.length; i++) column[i] = this.raw.columns.readDoubleLE(base + i * 8);
+  }
+  return column;
+}
+
+CompactFileList.prototype.path = function(i) {
+  return this.raw.names.toString("utf8", this.column("name_start")[i], this.column("name_end")[i]);
+}
+
+CompactFileList.prototype.type = function(i) {
+  var kind = String.fromCharCode(this.column("kind")[i]);
+  return kind == 'F' ? "file" : kind == 'D' ? "directory" : "other";
+}
+
+CompactFileList.prototype.owner = function(i) { return this.raw.users[this.column("owner")[i]]; }
+CompactFileList.prototype.group = function(i) { return this.raw.users[this.column("group")[i]]; }
+
+CompactFileList.prototype.get = function(i) {
+  return {
+    type:        this.type(i),
+    path:        this.path(i),
+    size:        this.column("size")[i],
+    replication: this.column("replication")[i],
+    block_size:  this.column("block_size")[i],
+    owner:       this.owner(i),
+    group:       this.group(i),
+    permissions: this.column("permissions")[i],
+    last_mod:    this.column("last_mod")[i],
+    last_access: this.column("last_access")[i]
+  };
+}
+
+CompactFileList.prototype.forEach = function(fn) {
+  for(var i = 0; i < this.length; i++) fn(this.get(i), i);
+}
+
+CompactFileList.prototype.toArray = function() {
+  var files = new Array(this.length);
+  for(var i = 0; i < this.length; i++) files[i] = this.get(i);
+  return files;
+}
+
+module.exports.CompactFileList = CompactFileList;
+
+// HDFS operations run on the addon's own threads, not node's libeio pool:
+// configureWorkers({metadataThreads, dataThreads}) sizes the two queues
+// (default 4 threads each, can only grow once started) and workerStats()
+// returns {metadata: {threads, pending, active, completed}, data: {...}}.
+module.exports.configureWorkers = HDFSBindings.configureWorkers;
+module.exports.workerStats = HDFSBindings.workerStats;
+
+// Starts the JVM ahead of the first connect, e.g. before a server starts
+// taking requests; cb(err, jvmStartMs).
+module.exports.warmup = function(cb) {
+  HDFSBindings.warmup(cb || function() {});
+}
+
+// Per-operation timings for all clients: stats() returns {op: {count, errors,
+// bytes, queue, service, loop, callback}}, each histogram being {count,
+// totalMs, meanMs, maxMs, p50Ms, p90Ms, p99Ms, buckets}. queue is time spent
+// waiting for a worker thread, service the libhdfs calls themselves, loop
+// the wait for the event loop once done, and callback the JS callback.
+module.exports.stats = HDFSBindings.opStats;
+module.exports.resetStats = HDFSBindings.resetOpStats;
+
+// fn({op, queueMs, serviceMs, loopMs, callbackMs, bytes, failed}) for each
+// operation that took longer than thresholdMs in all; onSlowOp(null) stops it.
+module.exports.onSlowOp = function(thresholdMs, fn) {
+  fn ? HDFSBindings.onSlowOp(thresholdMs, fn) : HDFSBindings.onSlowOp(null);
+}
+
+// Fixed-size buffers handed out and taken back by readers so a streaming
+// read does not allocate a new Buffer per chunk.
+var BufferPool = function(bufferSize, maxBuffers) {
+  this.bufferSize = bufferSize || 1024*1024;
+  this.maxBuffers = maxBuffers || 4;
+  this.free = [];
+}
+
+BufferPool.prototype.acquire = function() {
+  return this.free.pop() || new Buffer(this.bufferSize);
+}
+
+BufferPool.prototype.release = function(buffer) {
+  if(buffer.length == this.bufferSize && this.free.length < this.maxBuffers) {
+    this.free.push(buffer);
+  }
+}
+
+module.exports.BufferPool = BufferPool;
+
+// With a pool, "data" buffers are recycled once the handlers return:
+// consumers that keep a chunk around must copy it.
+// Readable stream: pause()/resume() and pipe() work as for fs streams, and at
+// most highWaterMark bytes (rounded to whole chunks, or `prefetch` chunks)
+// are read ahead of what has been emitted.
+var HDFSReader = function(HDFS, path, options) {
   var self = this;
+  if(typeof options == "number") options = {bufferSize: options};
+  options = options || {};
 
+  this.readable = true;
   this.handle = null;
-  this.offset = 0;
+  this.offset = options.start || 0; // plain JS number, exact well past 2 GB
   this.length = 0;
-  this.bufferSize = bufferSize || 1024*1024;
+  this.bufferSize = options.bufferSize || 1024*1024;
+  this.pool = options.pool === true ? new BufferPool(this.bufferSize, options.prefetch || 1) : options.pool;
+  // a chunk shorter than bufferSize means the end of the file
+  if(this.pool && this.pool.bufferSize < this.bufferSize) {
+    throw new TypeError("pool buffers are smaller than bufferSize");
+  }
+  // inflated data has no offsets to start from
+  if(options.codec && options.codec != "none" && options.start) {
+    throw new TypeError("start cannot be used with a codec, compressed files are read from the beginning");
+  }
+
+  var openOptions = {};
+  for(var key in options) {
+    if(key != "pool" && key != "start" && key != "prefetch" && key != "highWaterMark") openOptions[key] = options[key];
+  }
+  openOptions.bufferSize = Math.max(this.bufferSize, STREAM_IO_BUFFER_SIZE);
+
+  // read-ahead: up to `prefetch` chunk reads are kept in flight at increasing
+  // offsets and delivered in order; pause() stops issuing new ones
+  this.prefetch = Math.max(options.prefetch || Math.floor((options.highWaterMark || 0) / this.bufferSize), 1);
+  // compressed files are inflated as one sequential stream
+  if(options.codec && options.codec != "none") this.prefetch = 1;
+  this.nextOffset = this.offset;
+  this.inflight = 0;
+  this.ready = {};
+  this.readyCount = 0;
+  this.paused = false;
+  this.eof = false;
+  this.finished = false;
+
+  this.pause = function() {
+    self.paused = true;
+  };
+
+  this.resume = function() {
+    if(!self.paused) return;
+    self.paused = false;
+    if(self.handle !== null) self.read();
+  };
 
   this.read = function() {
-    HDFS.read(self.handle, self.offset, self.bufferSize, function(data) {
-      if(!data || data.length == 0) {
-        self.end();
-      } else {
-        self.emit("data", data);
-        self.offset += data.length;
-        data.length < self.bufferSize ? self.end() : self.read();
+    self.deliver();
+    while(!self.paused && !self.eof && !self.finished && self.inflight + self.readyCount < self.prefetch) {
+      self.readChunk(self.nextOffset);
+      self.nextOffset += self.bufferSize;
+    }
+  };
+
+  this.readChunk = function(offset) {
+    self.inflight++;
+    var done = function(err, data, buffer) {
+      self.inflight--;
+      if(err || data.length < self.bufferSize) self.eof = true;
+      self.ready[offset] = {err: err, data: data, buffer: buffer};
+      self.readyCount++;
+      self.finished ? self.finish() : self.read();
+    };
+
+    if(self.pool) {
+      var buffer = self.pool.acquire();
+      if(buffer.length < self.bufferSize) {
+        return process.nextTick(function() { done("pool buffers are smaller than bufferSize", new Buffer(0), buffer); });
       }
-    });
+      HDFS.readInto(self.handle, offset, buffer, 0, self.bufferSize, function(err, readBytes) {
+        done(err, readBytes < buffer.length ? buffer.slice(0, readBytes) : buffer, buffer);
+      });
+    } else {
+      HDFS.read(self.handle, offset, self.bufferSize, function(data, err) {
+        done(err || null, data || new Buffer(0));
+      });
+    }
+  };
+
+  this.deliver = function() {
+    var chunk;
+    while(!self.paused && !self.finished && (chunk = self.ready[self.offset])) {
+      delete self.ready[self.offset];
+      self.readyCount--;
+      if(chunk.data.length > 0) self.emit("data", chunk.data);
+      if(chunk.buffer) self.pool.release(chunk.buffer);
+      self.offset += chunk.data.length;
+      if(chunk.err || chunk.data.length < self.bufferSize) self.finish(chunk.err);
+    }
+  };
+
+  // waits for reads still in flight past the end before closing the handle
+  this.finish = function(err) {
+    self.finished = true;
+    if(err) self.error = err;
+    if(self.inflight > 0) return;
+    for(var offset in self.ready) {
+      if(self.ready[offset].buffer) self.pool.release(self.ready[offset].buffer);
+    }
+    self.ready = {};
+    self.end(self.error);
+  };
+
+  // stops reading early, e.g. when the destination of a pipe() goes away
+  this.destroy = function() {
+    if(!self.finished) self.finish();
   };
 
   this.end = function(err) {
-    if(self.handle) {
+    self.readable = false;
+    if(self.handle !== null) {
       HDFS.close(self.handle, function() {
         self.emit("end", err);
       })
@@ -266,7 +1105,7 @@ var HDFSReader = function(path, bufferSize) {
     }
   }
 
-  HDFS.open(path, modes.O_RDONLY, function(err, handle) {
+  HDFS.open(path, modes.O_RDONLY, openOptions, function(err, handle) {
     if(err) {
       self.end(err);
     } else {
@@ -276,75 +1115,274 @@ var HDFSReader = function(path, bufferSize) {
     }
   });
 
-  EventEmitter.call(this);
+  Stream.call(this);
+}
+
+sys.inherits(HDFSReader, Stream);
+
+// Records of one native readRecords() call: views into a single Buffer,
+// record(i) is a slice of it and toString(i) decodes it.
+var RecordBatch = function(buffer, positions) {
+  this.buffer = buffer;
+  this.positions = positions;
+  this.length = positions.length / 8;
 }
 
-sys.inherits(HDFSReader, EventEmitter);
+RecordBatch.prototype.start = function(i) { return this.positions.readUInt32LE(i * 8); }
+RecordBatch.prototype.recordLength = function(i) { return this.positions.readUInt32LE(i * 8 + 4); }
 
-var HDFSWritter = function(path, mode) {
+RecordBatch.prototype.record = function(i) {
+  var start = this.start(i);
+  return this.buffer.slice(start, start + this.recordLength(i));
+}
+
+RecordBatch.prototype.toString = function(i, encoding) {
+  var start = this.start(i);
+  return this.buffer.toString(encoding || "utf8", start, start + this.recordLength(i));
+}
+
+RecordBatch.prototype.forEach = function(fn) {
+  for(var i = 0; i < this.length; i++) fn(this.record(i), i);
+}
+
+module.exports.RecordBatch = RecordBatch;
+
+// Reads the records of a file, or of the split [start, end) of it: unless
+// start is 0 the partial record there belongs to the previous split and is
+// skipped, and the last record is read to its end even past `end`. One
+// native call is made at a time; pause() holds off the next one.
+var HDFSRecordReader = function(HDFS, path, options) {
   var self = this;
+  options = options || {};
+
+  this.readable = true;
   this.handle = null;
+  this.offset = options.start || 0;
+  this.paused = false;
+  this.reading = false;
+  this.destroyed = false;
+  this.finished = false;
+
+  var recordOptions = {bufferSize: options.bufferSize || 1024*1024, skipFirst: this.offset > 0};
+  if(options.end !== undefined) recordOptions.end = options.end;
+  if(options.delimiter !== undefined) recordOptions.delimiter = options.delimiter;
+  if(options.recordLength) recordOptions.recordLength = options.recordLength;
+
+  var openOptions = {};
+  for(var key in options) {
+    if(key != "start" && key != "end" && key != "delimiter" && key != "recordLength") openOptions[key] = options[key];
+  }
+
+  this.pause = function() {
+    self.paused = true;
+  };
+
+  this.resume = function() {
+    if(!self.paused) return;
+    self.paused = false;
+    if(self.handle !== null) self.read();
+  };
+
+  this.read = function() {
+    if(self.paused || self.reading || self.finished) return;
+    self.reading = true;
+    HDFS.readRecords(self.handle, self.offset, recordOptions, function(err, buffer, positions, nextOffset, done) {
+      self.reading = false;
+      if(err) return self.end(err);
+      recordOptions.skipFirst = false;
+      self.offset = nextOffset;
+      if(positions.length > 0 && !self.destroyed) self.emit("records", new RecordBatch(buffer, positions));
+      if(self.finished) return;  // destroyed by a "records" handler
+      done || self.destroyed ? self.end() : self.read();
+    });
+  };
+
+  // stops reading early; a call in flight is waited for before closing
+  this.destroy = function() {
+    if(self.finished || self.destroyed) return;
+    self.destroyed = true;
+    if(!self.reading) self.end();
+  };
+
+  this.end = function(err) {
+    self.finished = true;
+    self.readable = false;
+    if(self.handle !== null) {
+      HDFS.close(self.handle, function() {
+        self.emit("end", err);
+      })
+    } else {
+      self.emit("end", err);
+    }
+  }
+
+  HDFS.open(path, modes.O_RDONLY, openOptions, function(err, handle) {
+    if(err) {
+      self.end(err);
+    } else {
+      self.emit("open", handle);
+      self.handle = handle;
+      self.read();
+    }
+  });
+
+  Stream.call(this);
+}
+
+sys.inherits(HDFSRecordReader, Stream);
+
+// Writable stream: write() returns false once highWaterMark bytes (default
+// 4 MB) are waiting for the native writes, and "drain" is emitted when the
+// backlog is back under it, so pipe() and other producers can hold off.
+// A failed write loses the chunks it carried: nothing more is written and
+// the file is closed, with the error passed to "close".
+var HDFSWritter = function(HDFS, path, mode, options) {
+  var self = this;
+  options = options || {};
+  this.writable = true;
+  this.handle = undefined; // (null >= 0) is true, which would let writes through before open
   this.writting = false;
   this.closeCalled = false;
-  this.writeBuffer = new Buffer(0);
+  this.closing = false;
+  this.error = null;
+  this.waiting = [];       // afterPendingWrites() callbacks
+  this.writeQueue = [];
+  this.queuedBytes = 0;    // queued plus being written
+  this.highWaterMark = options.highWaterMark || WRITE_HIGH_WATER_MARK;
+  this.needDrain = false;
   mode = mode || (modes.O_WRONLY | modes.O_CREAT)
 
   this.write = function(buffer) {
-    self.expandBuffer(buffer);
-    if(self.handle >= 0) {
-      if(!self.writting) {
-        self.writting = true;
-        var newBuffer = self.writeBuffer;
-        self.writeBuffer = new Buffer(0);
-        HDFS.write(self.handle, newBuffer, function(len) {
-          self.writting = false
-          self.emit("write", len);
-          if(self.closeCalled) {
-            self.writeBuffer.length > 0 ? self.write() : self.end();
-          }
-        });
-      }
+    if(self.error) return false;
+    self.queueBuffer(buffer);
+    self.flushQueue();
+    if(self.queuedBytes < self.highWaterMark) return true;
+    self.needDrain = true;
+    return false;
+  };
+
+  // hands every queued chunk to a single native write call (writev-style)
+  this.flushQueue = function() {
+    if(self.handle >= 0 && !self.writting && self.writeQueue.length > 0) {
+      self.writting = true;
+      var chunks = self.writeQueue;
+      var chunkBytes = 0;
+      chunks.forEach(function(chunk) { chunkBytes += chunk.length; });
+      self.writeQueue = [];
+      HDFS.write(self.handle, chunks, function(len) {
+        self.writting = false
+        self.queuedBytes -= chunkBytes;
+        if(len < 0) return self.fail("Error writing file");
+        self.emit("write", len);
+        self.runWaiting();
+        if(self.needDrain && self.queuedBytes < self.highWaterMark) {
+          self.needDrain = false;
+          self.emit("drain");
+        }
+        if(self.writeQueue.length > 0) {
+          self.flushQueue();
+        } else if(self.closeCalled) {
+          self.end();
+        }
+      });
     }
   };
 
+  // pushes everything written so far out to the DataNodes, whatever the flush policy
+  this.flush = function(cb) {
+    self.afterPendingWrites(function(err) {
+      if(err) return cb && cb(err);
+      HDFS.flush(self.handle, function(err) { if(cb) cb(err); });
+    });
+  };
+
+  this.sync = function(cb) {
+    self.afterPendingWrites(function(err) {
+      if(err) return cb && cb(err);
+      HDFS.sync(self.handle, function(err) { if(cb) cb(err); });
+    });
+  };
+
+  // fn(err) once everything queued so far is written, or has failed
+  this.afterPendingWrites = function(fn) {
+    self.waiting.push(fn);
+    self.runWaiting();
+  };
+
+  this.runWaiting = function() {
+    if(!self.error && !(self.handle >= 0 && !self.writting && self.writeQueue.length == 0)) return;
+    var waiting = self.waiting;
+    self.waiting = [];
+    waiting.forEach(function(fn) { fn(self.error); });
+  };
+
+  // drops what is still queued and closes the file with err
+  this.fail = function(err) {
+    self.error = err;
+    self.writable = false;
+    self.writeQueue = [];
+    self.queuedBytes = 0;
+    self.runWaiting();
+    self.end(err);
+  };
+
+  // end([buffer]) writes the last chunk and closes the file once everything
+  // queued is written; err is passed on to "close"
   this.end = function(err) {
+    if(Buffer.isBuffer(err)) {
+      self.write(err);
+      err = undefined;
+    }
+    self.writable = false;
+    if(self.closing) return;
+    err = err || self.error;
     if(self.handle >= 0) {
-      if(!self.writting && self.writeBuffer.length == 0) {
-        HDFS.close(self.handle, function() {
+      if(!self.writting && self.writeQueue.length == 0) {
+        self.closing = true;
+        HDFS.close(self.handle, function(closeErr) {
           self.handle = undefined;
-          self.emit("close", err);
+          self.emit("close", err || closeErr);
         })
       } else {
         self.closeCalled = true;
-        self.write();
+        self.flushQueue();
       }
     } else {
+      self.closing = true;
       self.emit("close", err);
     }
   }
 
-  this.expandBuffer = function(buffer) {
+  this.queueBuffer = function(buffer) {
     if(buffer) {
-      if(buffer.constructor.name != "Buffer") {
+      if(!Buffer.isBuffer(buffer)) {
         buffer = new Buffer(buffer.toString());
       }
-      var newBuffer = new Buffer(self.writeBuffer.length + buffer.length);
-      self.writeBuffer.copy(newBuffer, 0, 0);
-      buffer.copy(newBuffer, self.writeBuffer.length, 0);
-      self.writeBuffer = newBuffer;
+      if(buffer.length > 0) {
+        self.writeQueue.push(buffer);
+        self.queuedBytes += buffer.length;
+      }
     }
   }
   
-  HDFS.open(path, mode, function(err, handle) {
+  var onOpen = function(err, handle) {
     if(err || !(handle >= 0)) {
-      self.end(err);
+      self.fail(err || "Error opening file");
     } else {
       self.handle = handle;
       self.emit("open", err, handle);
+      self.flushQueue();
+      self.runWaiting();
     }
-  });
+  };
 
-  EventEmitter.call(this);
+  var openOptions = {};
+  for(var key in options) if(key != "highWaterMark") openOptions[key] = options[key];
+  openOptions.bufferSize = openOptions.bufferSize || STREAM_IO_BUFFER_SIZE;
+
+  HDFS.open(path, mode, openOptions, onOpen);
+
+  Stream.call(this);
 }
 
-sys.inherits(HDFSWritter, EventEmitter);
+sys.inherits(HDFSWritter, Stream);
@@ -8,7 +8,21 @@
 #include <node_buffer.h>
 #include <node_object_wrap.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <fnmatch.h>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
 #include "../vendor/hdfs.h"
+#include "hdfs_connection_pool.h"
+#include "hdfs_worker_pool.h"
+#include "hdfs_file_table.h"
+#include "hdfs_metadata_cache.h"
+#include "hdfs_block_cache.h"
+#include "hdfs_codec.h"
+#include "hdfs_op_stats.h"
 
 using namespace node;
 using namespace v8;
@@ -19,14 +33,90 @@ using namespace v8;
                   String::New("Argument " #I " must be a function")));  \
   Local<Function> VAR = Local<Function>::Cast(args[I]);
 
+// When buffered writes are pushed out to the DataNodes with hdfsFlush
+enum hdfs_flush_policy_t {
+  FLUSH_WRITE = 0,  // after every write call (default)
+  FLUSH_NEVER,      // only when the file is closed, or on explicit flush()/sync()
+  FLUSH_BYTES,      // once at least flushBytes have been written since the last flush
+  FLUSH_INTERVAL    // on the first write after flushInterval ms since the last flush
+};
+
+static double now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// hdfsFileInfo entries that outlive the array libhdfs returned them in
+static void copyFileInfo(hdfsFileInfo *dst, const hdfsFileInfo *src)
+{
+  *dst = *src;
+  dst->mName = strdup(src->mName);
+  dst->mOwner = src->mOwner ? strdup(src->mOwner) : NULL;
+  dst->mGroup = src->mGroup ? strdup(src->mGroup) : NULL;
+}
+
+static void freeFileInfoCopy(hdfsFileInfo *info)
+{
+  free(info->mName);
+  free(info->mOwner);
+  free(info->mGroup);
+}
+
+// "hdfs://host:port/a/b" -> "/a/b"
+static const char *uriPath(const char *uri)
+{
+  const char *scheme = strstr(uri, "://");
+  if(!scheme) return uri;
+  const char *path = strchr(scheme + 3, '/');
+  return path ? path : "/";
+}
+
+static const char *baseName(const char *path)
+{
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+struct hdfs_file_t {
+  hdfsFile_internal *file;
+  hdfs_conn_t *conn;
+  hdfsFS fs;        // the handle the file was opened on, kept even if conn reconnects
+  char *path;
+  bool writable;
+  bool cached;      // reads go through the client's block cache
+  HdfsCodec *codec; // NULL unless opened with a compression codec
+  bool closing;
+  hdfs_flush_policy_t flushPolicy;
+  tOffset flushBytes;
+  int flushInterval;
+  // Writes and flushes of one file may run on several DATA workers at once;
+  // they hold writeLock for the hdfsWrite/codec calls and the flush state.
+  pthread_mutex_t writeLock;
+  tOffset unflushedBytes;
+  double lastFlush;
+  // per-handle stats, updated on the main thread
+  double openedAt;
+  double bytesRead;
+  double bytesWritten;
+  double ops;
+  double cacheHits;
+  double cacheMisses;
+  // operations submitted and not yet back on the main thread; a close
+  // waits in pendingClose until there are none
+  int inflight;
+  void *pendingClose;   // HdfsClient::hdfs_close_baton_t
+};
+
 class HdfsClient : public ObjectWrap
 {
 private:
   int m_count;
-  hdfsFS fs_;
-
-  int fh_count_;
-  hdfsFile_internal **fh_;
+  HdfsConnectionPool pool_;
+  HdfsFileTable files_;
+  HdfsMetadataCache cache_;
+  HdfsBlockCache blockCache_;
 public:
 
   static Persistent<FunctionTemplate> s_ct;
@@ -43,30 +133,225 @@ public:
     NODE_SET_PROTOTYPE_METHOD(s_ct, "connect", Connect);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "write", Write);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "read", Read);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "readInto", ReadInto);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "readv", Readv);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "readRecords", ReadRecords);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "seek", Seek);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "tell", Tell);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "stat", Stat);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "open", Open);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "close", Close);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "fileStats", FileStats);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "flush", Flush);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "sync", Sync);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "list", List);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "walk", Walk);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "blockLocations", BlockLocations);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "mkdir", CreateDirectory);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "exists", Exists);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "rm", Delete);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "batch", Batch);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "copy", Copy);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "move", Move);
     NODE_SET_PROTOTYPE_METHOD(s_ct, "disconnect", Disconnect);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "connectStats", ConnectStats);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "configureCache", ConfigureCache);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "cacheStats", CacheStats);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "configureReadCache", ConfigureReadCache);
+    NODE_SET_PROTOTYPE_METHOD(s_ct, "readCacheStats", ReadCacheStats);
 
     target->Set(String::NewSymbol("Hdfs"), s_ct->GetFunction());
+
+    NODE_SET_METHOD(target, "configureWorkers", ConfigureWorkers);
+    NODE_SET_METHOD(target, "workerStats", WorkerStats);
+    NODE_SET_METHOD(target, "warmup", WarmUp);
+    NODE_SET_METHOD(target, "opStats", OpStats);
+    NODE_SET_METHOD(target, "resetOpStats", ResetOpStats);
+    NODE_SET_METHOD(target, "onSlowOp", OnSlowOp);
+  }
+
+  // configureWorkers({metadataThreads, dataThreads})
+  static Handle<Value> ConfigureWorkers(const Arguments &args)
+  {
+    HandleScope scope;
+    if(!args[0]->IsObject()) {
+      return ThrowException(Exception::TypeError(String::New("Argument 0 must be an object")));
+    }
+    Local<Object> options = args[0]->ToObject();
+    HdfsWorkerPool::Instance().Configure(options->Get(String::NewSymbol("metadataThreads"))->Int32Value(),
+                                         options->Get(String::NewSymbol("dataThreads"))->Int32Value());
+    return Undefined();
+  }
+
+  // workerStats() -> {metadata: {threads, pending, active, completed}, data: {...}}
+  static Handle<Value> WorkerStats(const Arguments &args)
+  {
+    HandleScope scope;
+    Local<Object> stats = Object::New();
+    const char *names[HdfsWorkerPool::QUEUES] = { "metadata", "data" };
+
+    for(int q=0; q<HdfsWorkerPool::QUEUES; q++) {
+      HdfsWorkerPool::queue_stats_t queue = HdfsWorkerPool::Instance().Stats(q);
+      Local<Object> object = Object::New();
+      object->Set(String::NewSymbol("threads"),   Integer::New(queue.threads));
+      object->Set(String::NewSymbol("pending"),   Integer::New(queue.pending));
+      object->Set(String::NewSymbol("active"),    Integer::New(queue.active));
+      object->Set(String::NewSymbol("completed"), Number::New(queue.completed));
+      stats->Set(String::NewSymbol(names[q]), object);
+    }
+    return scope.Close(stats);
+  }
+
+  struct hdfs_warmup_baton_t {
+    Persistent<Function> cb;
+    bool started;
+  };
+
+  // warmup(cb) - starts the JVM on a metadata worker; cb(err, jvmStartMs)
+  static Handle<Value> WarmUp(const Arguments &args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(0, cb);
+
+    hdfs_warmup_baton_t *baton = new hdfs_warmup_baton_t();
+    baton->cb = Persistent<Function>::New(cb);
+    baton->started = false;
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "warmup", work_hdfs_warmup, after_hdfs_warmup, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_warmup(hdfs_work_t *req)
+  {
+    hdfs_warmup_baton_t *baton = static_cast<hdfs_warmup_baton_t*>(req->data);
+    baton->started = HdfsConnectionPool::WarmUp();
+    req->failed = !baton->started;
+    return 0;
+  }
+
+  static int after_hdfs_warmup(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_warmup_baton_t *baton = static_cast<hdfs_warmup_baton_t*>(req->data);
+    ev_unref(EV_DEFAULT_UC);
+
+    Local<Value> argv[2];
+    argv[0] = baton->started ? Local<Value>::New(Undefined()) : Local<Value>::New(String::New("Error starting the JVM"));
+    argv[1] = Local<Value>::New(Number::New(HdfsConnectionPool::JvmStartMs()));
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete baton;
+    return 0;
+  }
+
+  static Local<Object> HistogramObject(const HdfsOpStats::histogram_t &histogram)
+  {
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("count"),   Number::New(histogram.count));
+    result->Set(String::NewSymbol("totalMs"), Number::New(histogram.totalUs / 1000));
+    result->Set(String::NewSymbol("meanMs"),  Number::New(histogram.count ? histogram.totalUs / histogram.count / 1000 : 0));
+    result->Set(String::NewSymbol("maxMs"),   Number::New(histogram.maxUs / 1000));
+    result->Set(String::NewSymbol("p50Ms"),   Number::New(histogram.Percentile(0.5) / 1000));
+    result->Set(String::NewSymbol("p90Ms"),   Number::New(histogram.Percentile(0.9) / 1000));
+    result->Set(String::NewSymbol("p99Ms"),   Number::New(histogram.Percentile(0.99) / 1000));
+
+    // buckets[i]: samples of [2^i, 2^(i+1)) us, up to the last non-empty one
+    int used = HdfsOpStats::BUCKETS;
+    while(used > 0 && histogram.buckets[used - 1] == 0) used--;
+    Local<Array> buckets = Array::New(used);
+    for(int i=0; i<used; i++) buckets->Set(i, Number::New(histogram.buckets[i]));
+    result->Set(String::NewSymbol("buckets"), buckets);
+    return result;
+  }
+
+  // opStats() -> {op: {count, errors, bytes, queue, service, loop, callback}}
+  // where each histogram is {count, totalMs, meanMs, maxMs, p50Ms, p90Ms,
+  // p99Ms, buckets}. queue is the wait for a worker thread, service the
+  // libhdfs calls, loop the wait for the event loop and callback the JS callback.
+  static Handle<Value> OpStats(const Arguments &args)
+  {
+    HandleScope scope;
+    Local<Object> result = Object::New();
+    const HdfsOpStats::op_map_t &ops = HdfsOpStats::Instance().ops();
+
+    for(HdfsOpStats::op_map_t::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+      Local<Object> op = Object::New();
+      op->Set(String::NewSymbol("count"),    Number::New(it->second.count));
+      op->Set(String::NewSymbol("errors"),   Number::New(it->second.errors));
+      op->Set(String::NewSymbol("bytes"),    Number::New(it->second.bytes));
+      op->Set(String::NewSymbol("queue"),    HistogramObject(it->second.queue));
+      op->Set(String::NewSymbol("service"),  HistogramObject(it->second.service));
+      op->Set(String::NewSymbol("loop"),     HistogramObject(it->second.loop));
+      op->Set(String::NewSymbol("callback"), HistogramObject(it->second.callback));
+      result->Set(String::New(it->first.c_str()), op);
+    }
+    return scope.Close(result);
+  }
+
+  static Handle<Value> ResetOpStats(const Arguments &args)
+  {
+    HdfsOpStats::Instance().Reset();
+    return Undefined();
+  }
+
+  static Persistent<Function> s_slowOp;
+
+  // onSlowOp(thresholdMs, fn) - fn({op, queueMs, serviceMs, loopMs,
+  // callbackMs, bytes, failed}) after each request slower than thresholdMs
+  // overall; onSlowOp(null) stops it
+  static Handle<Value> OnSlowOp(const Arguments &args)
+  {
+    HandleScope scope;
+    if(!s_slowOp.IsEmpty()) {
+      s_slowOp.Dispose();
+      s_slowOp.Clear();
+    }
+    if(args.Length() > 1 && args[1]->IsFunction()) {
+      s_slowOp = Persistent<Function>::New(Local<Function>::Cast(args[1]));
+      HdfsOpStats::Instance().SetSlowListener(args[0]->NumberValue(), on_slow_op);
+    } else {
+      HdfsOpStats::Instance().SetSlowListener(0, NULL);
+    }
+    return Undefined();
+  }
+
+  static void on_slow_op(const HdfsOpStats::sample_t &sample)
+  {
+    HandleScope scope;
+    Local<Object> op = Object::New();
+    op->Set(String::NewSymbol("op"),         String::New(sample.op));
+    op->Set(String::NewSymbol("queueMs"),    Number::New(sample.queueUs / 1000));
+    op->Set(String::NewSymbol("serviceMs"),  Number::New(sample.serviceUs / 1000));
+    op->Set(String::NewSymbol("loopMs"),     Number::New(sample.loopUs / 1000));
+    op->Set(String::NewSymbol("callbackMs"), Number::New(sample.callbackUs / 1000));
+    op->Set(String::NewSymbol("bytes"),      Number::New(sample.bytes));
+    op->Set(String::NewSymbol("failed"),     Boolean::New(sample.failed));
+
+    Handle<Value> argv[1] = { op };
+    TryCatch try_catch;
+    s_slowOp->Call(Context::GetCurrent()->Global(), 1, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
   }
 
   HdfsClient()
   {
     m_count = 0;
-    fs_ = NULL;
-    fh_count_ = 1024;
-    fh_ = (hdfsFile_internal **) calloc(fh_count_, sizeof(hdfsFile_internal *));
-    memset(fh_, 0, sizeof(fh_count_ * sizeof(hdfsFile_internal **)));
   }
 
   ~HdfsClient()
   {
-    free(fh_);
   }
 
   static Handle<Value> New(const Arguments& args)
@@ -79,6 +364,7 @@ public:
 
   struct hdfs_path_baton_t {
     HdfsClient *client;
+    hdfs_conn_t *conn;
     char *filePath;
     Persistent<Function> cb;
     int result;
@@ -86,72 +372,255 @@ public:
 
   struct hdfs_open_baton_t {
     HdfsClient *client;
+    hdfs_conn_t *conn;
+    hdfsFS fs;
     char *filePath;
     Persistent<Function> cb;
     hdfsFile_internal *fileHandle;
     int flags;
+    int bufferSize;
+    short replication;
+    tSize blockSize;
+    hdfs_flush_policy_t flushPolicy;
+    tOffset flushBytes;
+    int flushInterval;
+    bool cached;
+    int codec;
+    int level;
+  };
+
+  struct hdfs_write_chunk_t {
+    char *data;
+    int length;
   };
 
   struct hdfs_write_baton_t {
     HdfsClient *client;
-    char *buffer;
-    int bufferLength;
-    hdfsFile_internal *fileHandle;
+    Persistent<Object> buffers;
+    hdfs_write_chunk_t *chunks;
+    int chunkCount;
+    int fh;
+    hdfs_file_t *file;
     Persistent<Function> cb;
     tSize writtenBytes;
   };
 
   struct hdfs_read_baton_t {
     HdfsClient *client;
+    hdfsFS fs;
     int fh;
     int bufferSize;
-    int offset;
+    tOffset offset;
+    hdfsFile_internal *fileHandle;
+    const char *cachePath;   // NULL when not reading through the block cache
+    HdfsCodec *codec;
+    Persistent<Function> cb;
+    char *buffer;
+    int readBytes;
+    int cacheHits;
+    int cacheMisses;
+  };
+
+  struct hdfs_read_into_baton_t {
+    HdfsClient *client;
+    hdfsFS fs;
+    int fh;
+    tOffset offset;
     hdfsFile_internal *fileHandle;
+    const char *cachePath;
+    HdfsCodec *codec;
     Persistent<Function> cb;
+    Persistent<Object> target;
     char *buffer;
+    int length;
     int readBytes;
+    int cacheHits;
+    int cacheMisses;
+  };
+
+  struct hdfs_pread_ctx_t {
+    hdfsFS fs;
+    hdfsFile_internal *file;
   };
 
   struct hdfs_stat_baton_t {
     HdfsClient *client;
+    hdfs_conn_t *conn;
     char *filePath;
     hdfsFileInfo *fileStat;
+    bool compact;
     Persistent<Function> cb;
   };
 
   struct hdfs_list_baton_t {
     HdfsClient *client;
+    hdfs_conn_t *conn;
     char *filePath;
     hdfsFileInfo *fileList;
     int numEntries;
+    bool compact;
+    Persistent<Function> cb;
+  };
+
+  struct hdfs_block_locations_baton_t {
+    HdfsClient *client;
+    hdfs_conn_t *conn;
+    char *filePath;
+    tOffset start;
+    tOffset length;
+    hdfsFileInfo *fileStat;
+    char ***hosts;
     Persistent<Function> cb;
   };
 
   struct hdfs_close_baton_t {
+    HdfsClient *client;
+    hdfs_file_t *file;
+    int fh;
+    hdfsFile_internal *fileHandle;
+    Persistent<Function> cb;
+  };
+
+  struct hdfs_seek_baton_t {
     HdfsClient *client;
     int fh;
+    hdfsFS fs;
     hdfsFile_internal *fileHandle;
     Persistent<Function> cb;
+    tOffset offset;
+    int result;
+  };
+
+  struct hdfs_flush_baton_t {
+    HdfsClient *client;
+    int fh;
+    hdfs_file_t *file;
+    Persistent<Function> cb;
+    int result;
   };
 
 
+  // connect(host, port, [user], [options], [cb])
+  // options: { poolSize, idleTimeout } - with a poolSize > 1 operations are
+  // spread over that many connections, see HdfsConnectionPool.
+  // Without cb the first connection is opened before returning true or
+  // false; with it connect returns at once and cb(err, connectStats) runs
+  // once the connection is up.
   static Handle<Value> Connect(const Arguments &args)
   {
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
     v8::String::Utf8Value hostStr(args[0]);
-    client->fs_ = hdfsConnectNewInstance(*hostStr, args[1]->Int32Value());
-    return Boolean::New(client->fs_ ? true : false);
+    v8::String::Utf8Value userStr(args[2]);
+    bool hasUser = args[2]->IsString() && userStr.length() > 0;
+    int poolSize = 1, idleTimeout = 0;
+
+    if(args[3]->IsObject()) {
+      Local<Object> options = args[3]->ToObject();
+      poolSize = options->Get(String::NewSymbol("poolSize"))->Int32Value();
+      idleTimeout = options->Get(String::NewSymbol("idleTimeout"))->Int32Value();
+    }
+
+    if(!args[4]->IsFunction()) {
+      double start = now_ms();
+      bool connected = client->pool_.Connect(*hostStr, args[1]->Int32Value(), hasUser ? *userStr : NULL, poolSize, idleTimeout);
+
+      // not a worker request, so recorded here: all service time, on the main thread
+      HdfsOpStats::sample_t sample;
+      sample.op = "connect";
+      sample.queueUs = 0;
+      sample.serviceUs = (now_ms() - start) * 1000;
+      sample.loopUs = 0;
+      sample.callbackUs = 0;
+      sample.bytes = 0;
+      sample.failed = !connected;
+      HdfsOpStats::Instance().Record(sample);
+
+      return Boolean::New(connected);
+    }
+
+    // Asynchronous: the first connection is opened on a metadata worker.
+    // Operations submitted before it is up wait for it on that worker.
+    client->pool_.Connect(*hostStr, args[1]->Int32Value(), hasUser ? *userStr : NULL, poolSize, idleTimeout, false);
+
+    hdfs_path_baton_t *baton = new hdfs_path_baton_t();
+    baton->client = client;
+    baton->conn = client->pool_.AcquireFirst();
+    baton->cb = Persistent<Function>::New(Local<Function>::Cast(args[4]));
+    baton->filePath = NULL;
+    baton->result = -1;
+
+    client->Ref();
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "connect", work_hdfs_connect, after_hdfs_connect, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_connect(hdfs_work_t *req)
+  {
+    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
+    baton->result = baton->client->pool_.Get(baton->conn) ? 0 : -1;
+    req->failed = baton->result != 0;
+    return 0;
+  }
+
+  static int after_hdfs_connect(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
+    baton->client->Unref();
+
+    Local<Value> argv[2];
+    argv[0] = baton->result == 0 ? Local<Value>::New(Undefined()) : Local<Value>::New(String::New("Error connecting to HDFS"));
+    argv[1] = Local<Value>::New(baton->client->ConnectStatsObject());
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete baton;
+    return 0;
+  }
+
+  // {connects, failures, lastMs, maxMs, totalMs, jvmStartMs, connected}
+  Local<Object> ConnectStatsObject()
+  {
+    HdfsConnectionPool::connect_stats_t stats = pool_.ConnectStats();
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("connects"),   Number::New(stats.connects));
+    result->Set(String::NewSymbol("failures"),   Number::New(stats.failures));
+    result->Set(String::NewSymbol("lastMs"),     Number::New(stats.lastMs));
+    result->Set(String::NewSymbol("maxMs"),      Number::New(stats.maxMs));
+    result->Set(String::NewSymbol("totalMs"),    Number::New(stats.totalMs));
+    result->Set(String::NewSymbol("jvmStartMs"), Number::New(HdfsConnectionPool::JvmStartMs()));
+    result->Set(String::NewSymbol("connected"),  Integer::New(pool_.connected()));
+    return result;
+  }
+
+  static Handle<Value> ConnectStats(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    return scope.Close(client->ConnectStatsObject());
   }
 
   static Handle<Value> Disconnect(const Arguments &args)
   {
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
-    hdfsDisconnect(client->fs_);
+    client->pool_.Disconnect();
     return Boolean::New(true);
   }
   
   /**** GENERIC PATH OP ****/
-  static Handle<Value> genericPathOp(int (*op)(eio_req*), const Arguments &args)
+  static Handle<Value> genericPathOp(const char *name, hdfs_work_fn op, const Arguments &args)
   {
     HandleScope scope;
     REQ_FUN_ARG(1, cb);
@@ -164,24 +633,26 @@ public:
 
     hdfs_path_baton_t *baton = new hdfs_path_baton_t();
     baton->client = client;
+    baton->conn = client->pool_.Acquire();
     baton->cb = Persistent<Function>::New(cb);
     baton->filePath = filePath;
     baton->result = -1;
 
     client->Ref();
 
-    eio_custom(op, EIO_PRI_DEFAULT, eio_after_hdfs_generic, baton);
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, name, op, after_hdfs_generic, baton);
     ev_ref(EV_DEFAULT_UC);
 
     return Undefined();
   }
 
-  static int eio_after_hdfs_generic(eio_req *req)
+  static int after_hdfs_generic(hdfs_work_t *req)
   {
     HandleScope scope;
     hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
 
     ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
     baton->client->Unref();
 
     Local<Value> argv[1];
@@ -197,7 +668,7 @@ public:
 
     baton->cb.Dispose();
 
-    free(baton->filePath);
+    delete [] baton->filePath;
     delete baton;
     return 0;
   }
@@ -205,11 +676,13 @@ public:
 
   /*********** STAT **********/
 
+  // stat(path, [options], cb) - options: { compact }
   static Handle<Value> Stat(const Arguments &args)
   {
     HandleScope scope;
 
-    REQ_FUN_ARG(1, cb);
+    int cbIndex = args[1]->IsFunction() ? 1 : 2;
+    REQ_FUN_ARG(cbIndex, cb);
 
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
 
@@ -219,37 +692,44 @@ public:
 
     hdfs_stat_baton_t *baton = new hdfs_stat_baton_t();
     baton->client = client;
+    baton->conn = client->pool_.Acquire();
     baton->cb = Persistent<Function>::New(cb);
     baton->filePath = statPath;
     baton->fileStat = NULL;
+    baton->compact = cbIndex == 2 && compactOption(args[1]);
 
     client->Ref();
 
-    eio_custom(eio_hdfs_stat, EIO_PRI_DEFAULT, eio_after_hdfs_stat, baton);
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "stat", work_hdfs_stat, after_hdfs_stat, baton);
     ev_ref(EV_DEFAULT_UC);
 
     return Undefined();
   }
 
-  static int eio_hdfs_stat(eio_req *req)
+  static int work_hdfs_stat(hdfs_work_t *req)
   {
     hdfs_stat_baton_t *baton = static_cast<hdfs_stat_baton_t*>(req->data);
-    baton->fileStat = hdfsGetPathInfo(baton->client->fs_, baton->filePath);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs) baton->fileStat = baton->client->GetPathInfo(fs, baton->filePath);
+    req->failed = !fs;
+    if(!baton->fileStat) baton->client->pool_.Failed(baton->conn, fs);
     return 0;
   }
 
-  static int eio_after_hdfs_stat(eio_req *req)
+  static int after_hdfs_stat(hdfs_work_t *req)
   {
     HandleScope scope;
     hdfs_stat_baton_t *baton = static_cast<hdfs_stat_baton_t*>(req->data);
     ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
     baton->client->Unref();
 
     Handle<Value> argv[2];
 
     if(baton->fileStat) {
       argv[0] = Local<Value>::New(Undefined());
-      argv[1] = Local<Value>::New(Persistent<Object>::New(baton->client->fileInfoToObject(baton->fileStat)));
+      argv[1] = baton->compact ? baton->client->fileInfosToCompact(baton->fileStat, 1)
+                               : baton->client->fileInfoToObject(baton->fileStat);
       hdfsFreeFileInfo(baton->fileStat, 1);
     } else {
       argv[0] = Local<Value>::New(String::New("File does not exist"));
@@ -277,24 +757,99 @@ public:
 
     object->Set(String::New("type"),        String::New(kind == 'F' ? "file" : kind == 'D' ? "directory" : "other"));
     object->Set(String::New("path"),        String::New(path));
-    object->Set(String::New("size"),        Integer::New(fileStat->mSize));
+    object->Set(String::New("size"),        Number::New((double)fileStat->mSize));
     object->Set(String::New("replication"), Integer::New(fileStat->mReplication));
-    object->Set(String::New("block_size"),  Integer::New(fileStat->mBlockSize));
+    object->Set(String::New("block_size"),  Number::New((double)fileStat->mBlockSize));
     object->Set(String::New("owner"),       String::New(fileStat->mOwner));
     object->Set(String::New("group"),       String::New(fileStat->mGroup));
     object->Set(String::New("permissions"), Integer::New(fileStat->mPermissions));
-    object->Set(String::New("last_mod"),    Integer::New(fileStat->mLastMod));
-    object->Set(String::New("last_access"), Integer::New(fileStat->mLastAccess));
+    object->Set(String::New("last_mod"),    Number::New((double)fileStat->mLastMod));
+    object->Set(String::New("last_access"), Number::New((double)fileStat->mLastAccess));
+
+    return object;
+  }
+
+  static bool compactOption(Handle<Value> options)
+  {
+    return options->IsObject() && options->ToObject()->Get(String::NewSymbol("compact"))->BooleanValue();
+  }
+
+  // Columnar form of a listing for large result sets: numeric fields go
+  // into one Buffer of doubles in host byte order (COMPACT_COLUMNS columns of n
+  // entries each), paths into one UTF-8 Buffer, and owner/group names are
+  // interned into a short array. The JS CompactFileList wraps the result.
+  enum {
+    COMPACT_KIND = 0, COMPACT_SIZE, COMPACT_REPLICATION, COMPACT_BLOCK_SIZE,
+    COMPACT_PERMISSIONS, COMPACT_LAST_MOD, COMPACT_LAST_ACCESS, COMPACT_OWNER,
+    COMPACT_GROUP, COMPACT_NAME_START, COMPACT_NAME_END, COMPACT_COLUMNS
+  };
+
+  Local<Object> fileInfosToCompact(hdfsFileInfo *infos, int n)
+  {
+    Buffer *columns = Buffer::New(sizeof(double) * COMPACT_COLUMNS * (n > 0 ? n : 1));
+    double *col = (double *) Buffer::Data(columns);
+
+    size_t namesLength = 0;
+    for(int i=0; i<n; i++) namesLength += strlen(infos[i].mName);
+    Buffer *names = Buffer::New(namesLength > 0 ? namesLength : 1);
+    char *name = Buffer::Data(names);
+
+    std::map<std::string, int> interned;
+    Local<Array> users = Array::New();
+    size_t nameStart = 0;
+
+    for(int i=0; i<n; i++) {
+      hdfsFileInfo *info = &infos[i];
+      const char *ids[2] = { info->mOwner ? info->mOwner : "", info->mGroup ? info->mGroup : "" };
+      int idx[2];
+
+      for(int k=0; k<2; k++) {
+        std::map<std::string, int>::iterator it = interned.find(ids[k]);
+        if(it == interned.end()) {
+          idx[k] = interned.size();
+          interned[ids[k]] = idx[k];
+          users->Set(idx[k], String::New(ids[k]));
+        } else {
+          idx[k] = it->second;
+        }
+      }
+
+      size_t nameLength = strlen(info->mName);
+      memcpy(name + nameStart, info->mName, nameLength);
+
+      col[COMPACT_KIND * n + i]        = (char) info->mKind;
+      col[COMPACT_SIZE * n + i]        = (double) info->mSize;
+      col[COMPACT_REPLICATION * n + i] = info->mReplication;
+      col[COMPACT_BLOCK_SIZE * n + i]  = (double) info->mBlockSize;
+      col[COMPACT_PERMISSIONS * n + i] = info->mPermissions;
+      col[COMPACT_LAST_MOD * n + i]    = (double) info->mLastMod;
+      col[COMPACT_LAST_ACCESS * n + i] = (double) info->mLastAccess;
+      col[COMPACT_OWNER * n + i]       = idx[0];
+      col[COMPACT_GROUP * n + i]       = idx[1];
+      col[COMPACT_NAME_START * n + i]  = nameStart;
+      col[COMPACT_NAME_END * n + i]    = nameStart + nameLength;
+
+      nameStart += nameLength;
+    }
 
+    Local<Object> object = Object::New();
+    object->Set(String::NewSymbol("compact"), Boolean::New(true));
+    object->Set(String::NewSymbol("length"),  Integer::New(n));
+    object->Set(String::NewSymbol("columns"), Local<Object>::New(columns->handle_));
+    object->Set(String::NewSymbol("names"),   Local<Object>::New(names->handle_));
+    object->Set(String::NewSymbol("users"),   users);
     return object;
   }
 
   /*********** List **********/
+
+  // list(path, [options], cb) - options: { compact }
   static Handle<Value> List(const Arguments &args)
   {
     HandleScope scope;
 
-    REQ_FUN_ARG(1, cb);
+    int cbIndex = args[1]->IsFunction() ? 1 : 2;
+    REQ_FUN_ARG(cbIndex, cb);
 
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
 
@@ -304,35 +859,45 @@ public:
 
     hdfs_list_baton_t *baton = new hdfs_list_baton_t();
     baton->client = client;
+    baton->conn = client->pool_.Acquire();
     baton->cb = Persistent<Function>::New(cb);
     baton->filePath = listPath;
     baton->fileList = NULL;
+    baton->compact = cbIndex == 2 && compactOption(args[1]);
 
     client->Ref();
 
-    eio_custom(eio_hdfs_list, EIO_PRI_DEFAULT, eio_after_hdfs_list, baton);
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "list", work_hdfs_list, after_hdfs_list, baton);
     ev_ref(EV_DEFAULT_UC);
 
     return Undefined();
   }
 
-  static int eio_hdfs_list(eio_req *req)
+  static int work_hdfs_list(hdfs_work_t *req)
   {
     hdfs_list_baton_t *baton = static_cast<hdfs_list_baton_t*>(req->data);
-    baton->fileList = hdfsListDirectory(baton->client->fs_, baton->filePath, &baton->numEntries);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs) baton->fileList = baton->client->ListDirectory(fs, baton->filePath, &baton->numEntries);
+    req->failed = !baton->fileList;
+    if(!baton->fileList) baton->client->pool_.Failed(baton->conn, fs);
     return 0;
   }
 
-  static int eio_after_hdfs_list(eio_req *req)
+  static int after_hdfs_list(hdfs_work_t *req)
   {
     HandleScope scope;
     hdfs_list_baton_t *baton = static_cast<hdfs_list_baton_t*>(req->data);
     ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
     baton->client->Unref();
 
     Handle<Value> argv[2];
 
-    if(baton->fileList) {
+    if(baton->fileList && baton->compact) {
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = baton->client->fileInfosToCompact(baton->fileList, baton->numEntries);
+      hdfsFreeFileInfo(baton->fileList, baton->numEntries);
+    } else if(baton->fileList) {
       Local<Array> listArray = Array::New(baton->numEntries);
 
       for(int i=0; i<baton->numEntries; i++) {
@@ -361,92 +926,581 @@ public:
 
 
 
-  /**********************/
-  /* Open               */
-  /**********************/
-  // open(char *path, int flags, callback)
+  /*********** Walk **********/
 
-  static Handle<Value> Open(const Arguments &args)
+  // One recursive listing. Directories are listed by up to `parallel` worker
+  // requests at a time; each request filters its entries on the worker thread
+  // and only the merge and the result conversion happen on the main thread.
+  struct hdfs_walk_filter_t {
+    char *match;      // fnmatch() glob on the entry name, or NULL
+    char kind;        // 'F', 'D' or 0 for both
+    tOffset minSize;
+    tOffset maxSize;  // < 0 for no limit
+    tTime modifiedSince;
+  };
+
+  struct hdfs_walk_dir_t {
+    char *path;
+    int depth;
+  };
+
+  struct hdfs_walk_baton_t {
+    HdfsClient *client;
+    Persistent<Function> cb;
+    hdfs_walk_filter_t filter;
+    int maxDepth;   // <= 0 for no limit
+    int parallel;
+    int pageSize;   // 0 delivers everything in a single callback
+    bool compact;
+    int inflight;
+    bool failed;
+    std::deque<hdfs_walk_dir_t> pending;
+    std::vector<hdfsFileInfo> results;
+  };
+
+  struct hdfs_walk_req_t {
+    hdfs_walk_baton_t *walk;
+    hdfs_conn_t *conn;
+    hdfs_walk_dir_t dir;
+    bool listed;
+    std::vector<hdfsFileInfo> matched;
+    std::vector<hdfs_walk_dir_t> subdirs;
+  };
+
+  // walk(path, options, cb)
+  // options: { depth, parallel, pageSize, match, type: "file"|"directory",
+  //            minSize, maxSize, modifiedSince, compact }
+  // Callback receives (err, files, done); without a pageSize it is called
+  // once with done set to true.
+  static Handle<Value> Walk(const Arguments &args)
   {
     HandleScope scope;
+
     REQ_FUN_ARG(2, cb);
 
-    // get client
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
 
-    // Parse path
-    v8::String::Utf8Value pathStr(args[0]);
-    char* statPath = new char[strlen(*pathStr) + 1];
-    strcpy(statPath, *pathStr);
-
-    // Initialize baton
-    hdfs_open_baton_t *baton = new hdfs_open_baton_t();
+    hdfs_walk_baton_t *baton = new hdfs_walk_baton_t();
     baton->client = client;
     baton->cb = Persistent<Function>::New(cb);
-    baton->filePath = statPath;
-    baton->fileHandle = NULL;
-    baton->flags = args[1]->Int32Value();
+    baton->filter.match = NULL;
+    baton->filter.kind = 0;
+    baton->filter.minSize = 0;
+    baton->filter.maxSize = -1;
+    baton->filter.modifiedSince = 0;
+    baton->maxDepth = 0;
+    baton->parallel = 8;
+    baton->pageSize = 0;
+    baton->compact = compactOption(args[1]);
+    baton->inflight = 0;
+    baton->failed = false;
+
+    if(args[1]->IsObject()) {
+      Local<Object> options = args[1]->ToObject();
+      Local<Value> value;
+
+      if((value = options->Get(String::NewSymbol("depth")))->IsNumber()) baton->maxDepth = value->Int32Value();
+      if((value = options->Get(String::NewSymbol("parallel")))->IsNumber()) baton->parallel = value->Int32Value();
+      if((value = options->Get(String::NewSymbol("pageSize")))->IsNumber()) baton->pageSize = value->Int32Value();
+      if((value = options->Get(String::NewSymbol("minSize")))->IsNumber()) baton->filter.minSize = value->IntegerValue();
+      if((value = options->Get(String::NewSymbol("maxSize")))->IsNumber()) baton->filter.maxSize = value->IntegerValue();
+      if((value = options->Get(String::NewSymbol("modifiedSince")))->IsNumber()) baton->filter.modifiedSince = value->IntegerValue();
+      if((value = options->Get(String::NewSymbol("match")))->IsString()) {
+        v8::String::Utf8Value matchStr(value);
+        baton->filter.match = strdup(*matchStr);
+      }
+      if((value = options->Get(String::NewSymbol("type")))->IsString()) {
+        v8::String::Utf8Value typeStr(value);
+        baton->filter.kind = !strcmp(*typeStr, "file") ? 'F' : !strcmp(*typeStr, "directory") ? 'D' : 0;
+      }
+    }
+    if(baton->parallel < 1) baton->parallel = 1;
+    if(baton->pageSize < 0) baton->pageSize = 0;
 
-    client->Ref();
+    v8::String::Utf8Value pathStr(args[0]);
+    hdfs_walk_dir_t root;
+    root.path = strdup(*pathStr);
+    root.depth = 0;
+    baton->pending.push_back(root);
 
-    // Call eio operation
-    eio_custom(eio_hdfs_open, EIO_PRI_DEFAULT, eio_after_hdfs_open, baton);
-    ev_ref(EV_DEFAULT_UC);
+    client->Ref();
+    WalkPump(baton);
 
     return Undefined();
   }
 
-  static int eio_hdfs_open(eio_req *req)
+  static void WalkPump(hdfs_walk_baton_t *walk)
   {
-    hdfs_open_baton_t *baton = static_cast<hdfs_open_baton_t*>(req->data);
-    baton->fileHandle = hdfsOpenFile(baton->client->fs_, baton->filePath, baton->flags, 0, 0, 0);
-    return 0;
+    while(!walk->failed && walk->inflight < walk->parallel && !walk->pending.empty()) {
+      hdfs_walk_req_t *req = new hdfs_walk_req_t();
+      req->walk = walk;
+      req->conn = walk->client->pool_.Acquire();
+      req->dir = walk->pending.front();
+      req->listed = false;
+      walk->pending.pop_front();
+      walk->inflight++;
+
+      HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "walk", work_hdfs_walk, after_hdfs_walk, req);
+      ev_ref(EV_DEFAULT_UC);
+    }
   }
 
-  int CreateFileHandle(hdfsFile_internal *f)
+  static bool WalkMatches(const hdfs_walk_filter_t &filter, const hdfsFileInfo *info)
   {
-    // TODO: quick and dirty, totally inefficient!
-    int fh = 0;
-    while(fh < fh_count_ && fh_[fh]) fh++;
-    if(fh >= fh_count_) return -1;
-    fh_[fh] = f;
-    return fh;
+    if(filter.kind && (char)info->mKind != filter.kind) return false;
+    if(info->mKind == kObjectKindFile) {
+      if(info->mSize < filter.minSize) return false;
+      if(filter.maxSize >= 0 && info->mSize > filter.maxSize) return false;
+    }
+    if(info->mLastMod < filter.modifiedSince) return false;
+    if(filter.match && fnmatch(filter.match, baseName(uriPath(info->mName)), 0) != 0) return false;
+    return true;
   }
 
-  hdfsFile_internal *GetFileHandle(int fh)
+  static int work_hdfs_walk(hdfs_work_t *req)
   {
-    return fh_[fh];
-  }
+    hdfs_walk_req_t *walkReq = static_cast<hdfs_walk_req_t*>(req->data);
+    hdfs_walk_baton_t *walk = walkReq->walk;
+
+    int numEntries = 0;
+    hdfsFS fs = walk->client->pool_.Get(walkReq->conn);
+    hdfsFileInfo *list = fs ? hdfsListDirectory(fs, walkReq->dir.path, &numEntries) : NULL;
+    req->failed = !list;
+    if(!list) {
+      walk->client->pool_.Failed(walkReq->conn, fs);
+      return 0;
+    }
+    walkReq->listed = true;
+
+    int depth = walkReq->dir.depth + 1;
+    for(int i=0; i<numEntries; i++) {
+      if(list[i].mKind == kObjectKindDirectory && (walk->maxDepth <= 0 || depth < walk->maxDepth)) {
+        hdfs_walk_dir_t dir;
+        dir.path = strdup(uriPath(list[i].mName));
+        dir.depth = depth;
+        walkReq->subdirs.push_back(dir);
+      }
+      if(WalkMatches(walk->filter, &list[i])) {
+        hdfsFileInfo copy;
+        copyFileInfo(&copy, &list[i]);
+        walkReq->matched.push_back(copy);
+      }
+    }
 
-  void RemoveFileHandle(int fh)
-  {
-    fh_[fh] = NULL;
+    hdfsFreeFileInfo(list, numEntries);
+    return 0;
   }
 
-  static int eio_after_hdfs_open(eio_req *req)
+  static int after_hdfs_walk(hdfs_work_t *req)
   {
     HandleScope scope;
-    hdfs_open_baton_t *baton = static_cast<hdfs_open_baton_t*>(req->data);
+    hdfs_walk_req_t *walkReq = static_cast<hdfs_walk_req_t*>(req->data);
+    hdfs_walk_baton_t *walk = walkReq->walk;
 
     ev_unref(EV_DEFAULT_UC);
-    baton->client->Unref();
+    walk->client->pool_.Release(walkReq->conn);
+    walk->inflight--;
 
-    Handle<Value> argv[2];
+    // an unreadable (or, with older libhdfs, empty) subdirectory is skipped;
+    // only a missing root is an error
+    if(!walkReq->listed && walkReq->dir.depth == 0) {
+      walk->failed = true;
+    }
 
-    if(baton->fileHandle) {
-      int fh = baton->client->CreateFileHandle(baton->fileHandle);
-      if(fh >= 0) {
-        argv[0] = Local<Value>::New(Undefined());
-        argv[1] = Local<Value>::New(Integer::New(fh));
-      } else {
-        argv[0] = Local<Value>::New(String::New("Too many open files"));
-        argv[1] = Local<Value>::New(Undefined());
-      }
-    } else {
-      argv[0] = Local<Value>::New(String::New("File does not exist"));
+    walk->results.insert(walk->results.end(), walkReq->matched.begin(), walkReq->matched.end());
+    walk->pending.insert(walk->pending.end(), walkReq->subdirs.begin(), walkReq->subdirs.end());
+    free(walkReq->dir.path);
+    delete walkReq;
+
+    if(walk->failed) {
+      for(size_t i=0; i<walk->pending.size(); i++) free(walk->pending[i].path);
+      walk->pending.clear();
+    }
+
+    bool done = walk->inflight == 0 && walk->pending.empty();
+
+    if(walk->failed) {
+      if(done) WalkCallback(walk, String::New("File does not exist"), true);
+    } else if(done || (walk->pageSize > 0 && (int)walk->results.size() >= walk->pageSize)) {
+      WalkCallback(walk, Undefined(), done);
+    }
+
+    if(done) {
+      walk->client->Unref();
+      walk->cb.Dispose();
+      free(walk->filter.match);
+      delete walk;
+    } else {
+      WalkPump(walk);
+    }
+    return 0;
+  }
+
+  static void WalkCallback(hdfs_walk_baton_t *walk, Handle<Value> err, bool done)
+  {
+    Handle<Value> argv[3];
+    argv[0] = err;
+
+    if(err->IsUndefined() && walk->compact) {
+      argv[1] = walk->client->fileInfosToCompact(walk->results.empty() ? NULL : &walk->results[0], walk->results.size());
+    } else if(err->IsUndefined()) {
+      Local<Array> files = Array::New(walk->results.size());
+      for(size_t i=0; i<walk->results.size(); i++) {
+        files->Set(i, walk->client->fileInfoToObject(&walk->results[i]));
+      }
+      argv[1] = files;
+    } else {
+      argv[1] = Undefined();
+    }
+    argv[2] = Boolean::New(done);
+
+    for(size_t i=0; i<walk->results.size(); i++) freeFileInfoCopy(&walk->results[i]);
+    walk->results.clear();
+
+    TryCatch try_catch;
+    walk->cb->Call(Context::GetCurrent()->Global(), 3, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+  }
+
+  /*********** Block locations **********/
+
+  // blockLocations(path, start, length, cb)
+  // Callback receives (err, [{offset, length, hosts: [...]}, ...]) with one
+  // entry per block overlapping [start, start+length). A length <= 0 means
+  // up to the end of the file.
+  static Handle<Value> BlockLocations(const Arguments &args)
+  {
+    HandleScope scope;
+
+    REQ_FUN_ARG(3, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    v8::String::Utf8Value pathStr(args[0]);
+    char* filePath = new char[strlen(*pathStr) + 1];
+    strcpy(filePath, *pathStr);
+
+    hdfs_block_locations_baton_t *baton = new hdfs_block_locations_baton_t();
+    baton->client = client;
+    baton->conn = client->pool_.Acquire();
+    baton->cb = Persistent<Function>::New(cb);
+    baton->filePath = filePath;
+    baton->start = args[1]->IntegerValue();
+    baton->length = args[2]->IntegerValue();
+    baton->fileStat = NULL;
+    baton->hosts = NULL;
+
+    client->Ref();
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "blockLocations", work_hdfs_block_locations, after_hdfs_block_locations, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_block_locations(hdfs_work_t *req)
+  {
+    hdfs_block_locations_baton_t *baton = static_cast<hdfs_block_locations_baton_t*>(req->data);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs) baton->fileStat = hdfsGetPathInfo(fs, baton->filePath);
+    req->failed = !baton->fileStat;
+    if(!baton->fileStat) baton->client->pool_.Failed(baton->conn, fs);
+    if(!baton->fileStat || baton->fileStat->mKind != kObjectKindFile) return 0;
+
+    if(baton->start < 0) baton->start = 0;
+    if(baton->length <= 0 || baton->start + baton->length > baton->fileStat->mSize) {
+      baton->length = baton->fileStat->mSize - baton->start;
+    }
+    if(baton->length > 0) {
+      baton->hosts = hdfsGetHosts(fs, baton->filePath, baton->start, baton->length);
+    }
+    return 0;
+  }
+
+  static int after_hdfs_block_locations(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_block_locations_baton_t *baton = static_cast<hdfs_block_locations_baton_t*>(req->data);
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
+    baton->client->Unref();
+
+    Handle<Value> argv[2];
+
+    if(!baton->fileStat || baton->fileStat->mKind != kObjectKindFile) {
+      argv[0] = Local<Value>::New(String::New(baton->fileStat ? "Not a file" : "File does not exist"));
+      argv[1] = Local<Value>::New(Undefined());
+    } else if(baton->length > 0 && !baton->hosts) {
+      argv[0] = Local<Value>::New(String::New("Error getting block locations"));
+      argv[1] = Local<Value>::New(Undefined());
+    } else {
+      Local<Array> blocks = Array::New();
+      tOffset blockSize = baton->fileStat->mBlockSize;
+      tOffset fileSize = baton->fileStat->mSize;
+      tOffset offset = blockSize > 0 ? baton->start - baton->start % blockSize : 0;
+
+      for(int i=0; baton->hosts && baton->hosts[i]; i++) {
+        tOffset length = blockSize > 0 && offset + blockSize < fileSize ? blockSize : fileSize - offset;
+
+        Local<Array> hosts = Array::New();
+        for(int j=0; baton->hosts[i][j]; j++) {
+          hosts->Set(j, String::New(baton->hosts[i][j]));
+        }
+
+        Local<Object> block = Object::New();
+        block->Set(String::NewSymbol("offset"), Number::New((double)offset));
+        block->Set(String::NewSymbol("length"), Number::New((double)length));
+        block->Set(String::NewSymbol("hosts"),  hosts);
+        blocks->Set(i, block);
+
+        offset += length;
+      }
+
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = Local<Value>::New(blocks);
+    }
+
+    if(baton->hosts) hdfsFreeHosts(baton->hosts);
+    if(baton->fileStat) hdfsFreeFileInfo(baton->fileStat, 1);
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete [] baton->filePath;
+    delete baton;
+    return 0;
+  }
+
+  /**********************/
+  /* Open               */
+  /**********************/
+  // open(char *path, int flags, [options], callback)
+  // options: { bufferSize, replication, blockSize,
+  //            flush: "write"|"never"|"bytes"|"interval", flushBytes, flushInterval,
+  //            cache, codec: "none"|"gzip", level }
+  // bufferSize, replication and blockSize left out (or 0) use the cluster defaults.
+  // With a codec, data is inflated after reading or deflated (at level 0-9)
+  // before writing on the worker thread, see HdfsCodec.
+
+  static Handle<Value> Open(const Arguments &args)
+  {
+    HandleScope scope;
+    int cbIndex = args[2]->IsFunction() ? 2 : 3;
+    REQ_FUN_ARG(cbIndex, cb);
+
+    // get client
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    // Parse path
+    v8::String::Utf8Value pathStr(args[0]);
+    char* statPath = new char[strlen(*pathStr) + 1];
+    strcpy(statPath, *pathStr);
+
+    // Initialize baton
+    hdfs_open_baton_t *baton = new hdfs_open_baton_t();
+    baton->client = client;
+    baton->conn = NULL;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->filePath = statPath;
+    baton->fileHandle = NULL;
+    baton->flags = args[1]->Int32Value();
+    baton->bufferSize = 0;
+    baton->replication = 0;
+    baton->blockSize = 0;
+    baton->flushPolicy = FLUSH_WRITE;
+    baton->flushBytes = 0;
+    baton->flushInterval = 0;
+    baton->cached = false;
+    baton->codec = HdfsCodec::NONE;
+    baton->level = -1;
+
+    if(cbIndex == 3 && args[2]->IsObject()) {
+      Local<Object> options = args[2]->ToObject();
+      baton->bufferSize = options->Get(String::NewSymbol("bufferSize"))->Int32Value();
+      baton->replication = (short) options->Get(String::NewSymbol("replication"))->Int32Value();
+      baton->blockSize = options->Get(String::NewSymbol("blockSize"))->Int32Value();
+
+      Local<Value> flush = options->Get(String::NewSymbol("flush"));
+      if(flush->IsString()) {
+        v8::String::Utf8Value flushStr(flush);
+        if(!strcmp(*flushStr, "never")) {
+          baton->flushPolicy = FLUSH_NEVER;
+        } else if(!strcmp(*flushStr, "bytes")) {
+          baton->flushPolicy = FLUSH_BYTES;
+        } else if(!strcmp(*flushStr, "interval")) {
+          baton->flushPolicy = FLUSH_INTERVAL;
+        } else if(strcmp(*flushStr, "write")) {
+          delete [] statPath;
+          baton->cb.Dispose();
+          delete baton;
+          return ThrowException(Exception::TypeError(String::New("Unknown flush policy")));
+        }
+      }
+      baton->flushBytes = options->Get(String::NewSymbol("flushBytes"))->IntegerValue();
+      baton->flushInterval = options->Get(String::NewSymbol("flushInterval"))->Int32Value();
+      baton->cached = options->Get(String::NewSymbol("cache"))->BooleanValue();
+
+      Local<Value> codec = options->Get(String::NewSymbol("codec"));
+      if(codec->IsString()) {
+        v8::String::Utf8Value codecStr(codec);
+        baton->codec = HdfsCodec::Parse(*codecStr);
+        if(baton->codec < 0) {
+          delete [] statPath;
+          baton->cb.Dispose();
+          delete baton;
+          return ThrowException(Exception::TypeError(String::New("Unknown codec")));
+        }
+      }
+      Local<Value> level = options->Get(String::NewSymbol("level"));
+      if(level->IsNumber()) baton->level = level->Int32Value();
+    }
+
+    baton->conn = client->pool_.Acquire();
+    client->Ref();
+
+    // Queue the operation
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "open", work_hdfs_open, after_hdfs_open, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_open(hdfs_work_t *req)
+  {
+    hdfs_open_baton_t *baton = static_cast<hdfs_open_baton_t*>(req->data);
+    hdfsFS fs = baton->fs = baton->client->pool_.Get(baton->conn);
+    req->failed = !fs;
+    if(!fs) return 0;
+    baton->fileHandle = hdfsOpenFile(fs, baton->filePath, baton->flags,
+                                      baton->bufferSize, baton->replication, baton->blockSize);
+    req->failed = !baton->fileHandle;
+    if(!baton->fileHandle) baton->client->pool_.Failed(baton->conn, fs);
+    if(baton->flags & (O_WRONLY|O_APPEND)) baton->client->PathChanged(baton->filePath);
+    return 0;
+  }
+
+  int CreateFileHandle(hdfs_file_t *f)
+  {
+    return files_.Create(f);
+  }
+
+  // NULL for unknown, stale or closing handles
+  hdfs_file_t *GetFile(int fh)
+  {
+    hdfs_file_t *file = files_.Get(fh);
+    return file && !file->closing ? file : NULL;
+  }
+
+  hdfsFile_internal *GetFileHandle(int fh)
+  {
+    hdfs_file_t *file = GetFile(fh);
+    return file ? file->file : NULL;
+  }
+
+  // counts a finished operation against a handle that may have been closed since
+  void FileOpDone(int fh, double bytesRead, double bytesWritten, int cacheHits = 0, int cacheMisses = 0)
+  {
+    hdfs_file_t *file = files_.Get(fh);
+    if(!file) return;
+    file->ops++;
+    if(bytesRead > 0) file->bytesRead += bytesRead;
+    if(bytesWritten > 0) file->bytesWritten += bytesWritten;
+    file->cacheHits += cacheHits;
+    file->cacheMisses += cacheMisses;
+  }
+
+  void FileOpStart(hdfs_file_t *file)
+  {
+    file->inflight++;
+  }
+
+  // called by every operation started with FileOpStart once it is back on
+  // the main thread, closing or not
+  void FileOpEnd(int fh)
+  {
+    hdfs_file_t *file = files_.Get(fh);
+    if(!file || --file->inflight > 0 || !file->pendingClose) return;
+    hdfs_close_baton_t *baton = static_cast<hdfs_close_baton_t*>(file->pendingClose);
+    file->pendingClose = NULL;
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "close", work_hdfs_close, after_hdfs_close, baton);
+  }
+
+  void RemoveFileHandle(int fh)
+  {
+    hdfs_file_t *file = files_.Remove(fh);
+    if(!file) return;
+    pthread_mutex_destroy(&file->writeLock);
+    delete file->codec;
+    delete [] file->path;
+    delete file;
+  }
+
+  static int after_hdfs_open(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_open_baton_t *baton = static_cast<hdfs_open_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+    HdfsConnectionPool &pool = baton->client->pool_;
+
+    Handle<Value> argv[2];
+
+    if(baton->fileHandle) {
+      hdfs_file_t *file = new hdfs_file_t();
+      file->file = baton->fileHandle;
+      file->conn = baton->conn;
+      file->fs = baton->fs;
+      file->path = baton->filePath;
+      file->writable = (baton->flags & (O_WRONLY|O_APPEND)) != 0;
+      file->cached = baton->cached && !file->writable && baton->codec == HdfsCodec::NONE;
+      file->codec = baton->codec != HdfsCodec::NONE ? new HdfsCodec(baton->codec, file->writable, baton->level) : NULL;
+      file->cacheHits = 0;
+      file->cacheMisses = 0;
+      file->closing = false;
+      file->openedAt = now_ms();
+      file->bytesRead = 0;
+      file->bytesWritten = 0;
+      file->ops = 0;
+      file->inflight = 0;
+      file->pendingClose = NULL;
+      file->flushPolicy = baton->flushPolicy;
+      file->flushBytes = baton->flushBytes;
+      file->flushInterval = baton->flushInterval;
+      file->unflushedBytes = 0;
+      file->lastFlush = now_ms();
+      pthread_mutex_init(&file->writeLock, NULL);
+
+      int fh = baton->client->CreateFileHandle(file);
+      if(fh >= 0) {
+        pool.FileOpened(baton->conn);
+        argv[0] = Local<Value>::New(Undefined());
+        argv[1] = Local<Value>::New(Integer::New(fh));
+      } else {
+        hdfsCloseFile(baton->fs, baton->fileHandle);
+        pthread_mutex_destroy(&file->writeLock);
+        delete file->codec;
+        delete [] file->path;
+        delete file;
+        argv[0] = Local<Value>::New(String::New("Too many open files"));
+        argv[1] = Local<Value>::New(Undefined());
+      }
+    } else {
+      delete [] baton->filePath;
+      argv[0] = Local<Value>::New(String::New("File does not exist"));
       argv[1] = Local<Value>::New(Undefined());
     }
 
+    pool.Release(baton->conn);
+
     TryCatch try_catch;
     baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
 
@@ -477,35 +1531,53 @@ public:
     baton->client = client;
     baton->cb = Persistent<Function>::New(cb);
     baton->fh = args[0]->Int32Value();
-    baton->fileHandle = client->GetFileHandle(baton->fh);
+    baton->file = client->GetFile(baton->fh);
+    baton->fileHandle = baton->file ? baton->file->file : NULL;
+    if(baton->file) baton->file->closing = true;
 
     client->Ref();
-
-    // Call eio operation
-    eio_custom(eio_hdfs_close, EIO_PRI_DEFAULT, eio_after_hdfs_close, baton);
     ev_ref(EV_DEFAULT_UC);
 
+    // libhdfs must not close the file under a read or write still running
+    // on it; the last of them submits the close (see FileOpEnd)
+    if(baton->file && baton->file->inflight > 0) {
+      baton->file->pendingClose = baton;
+    } else {
+      HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "close", work_hdfs_close, after_hdfs_close, baton);
+    }
+
     return Undefined();
   }
 
-  static int eio_hdfs_close(eio_req *req)
+  static int work_hdfs_close(hdfs_work_t *req)
   {
     hdfs_close_baton_t *baton = static_cast<hdfs_close_baton_t*>(req->data);
-    if(baton->fileHandle) hdfsCloseFile(baton->client->fs_, baton->fileHandle);
+    if(baton->fileHandle && baton->file->codec) baton->file->codec->Flush(baton->file->fs, baton->fileHandle, true);
+    if(baton->fileHandle) req->failed = hdfsCloseFile(baton->file->fs, baton->fileHandle) != 0;
+    if(baton->fileHandle && baton->file->writable) baton->client->PathChanged(baton->file->path);
     return 0;
   }
 
-  static int eio_after_hdfs_close(eio_req *req)
+  static int after_hdfs_close(hdfs_work_t *req)
   {
     HandleScope scope;
     hdfs_close_baton_t *baton = static_cast<hdfs_close_baton_t*>(req->data);
 
     ev_unref(EV_DEFAULT_UC);
     baton->client->Unref();
-    baton->client->RemoveFileHandle(baton->fh);
+    Local<Value> argv[1];
+    if(baton->file) {
+      baton->client->pool_.FileClosed(baton->file->conn);
+      baton->client->RemoveFileHandle(baton->fh);
+      // for a written file this is where the last block is committed
+      argv[0] = req->failed ? Local<Value>::New(String::New("Error closing file")) : Local<Value>::New(Undefined());
+    } else {
+      // stale id, or a second close of the same handle
+      argv[0] = Local<Value>::New(String::New("Invalid file handle"));
+    }
 
     TryCatch try_catch;
-    baton->cb->Call(Context::GetCurrent()->Global(), 0, NULL);
+    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
 
     if (try_catch.HasCaught()) {
       FatalException(try_catch);
@@ -517,6 +1589,33 @@ public:
     return 0;
   }
 
+  // fileStats(handle) -> {path, opened, bytesRead, bytesWritten, ops}, plus
+  // {cacheHits, cacheMisses} in pages for files opened with the block cache;
+  // undefined for a closed or unknown handle
+  static Handle<Value> FileStats(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    hdfs_file_t *file = client->GetFile(args[0]->Int32Value());
+
+    if(!file) return Undefined();
+
+    Local<Object> stats = Object::New();
+    stats->Set(String::NewSymbol("path"),         String::New(file->path));
+    stats->Set(String::NewSymbol("opened"),       Number::New(file->openedAt));
+    stats->Set(String::NewSymbol("bytesRead"),    Number::New(file->bytesRead));
+    stats->Set(String::NewSymbol("bytesWritten"), Number::New(file->bytesWritten));
+    stats->Set(String::NewSymbol("ops"),          Number::New(file->ops));
+    if(file->codec) {
+      stats->Set(String::NewSymbol("compressedBytes"), Number::New(file->codec->compressedBytes()));
+    }
+    if(file->cached) {
+      stats->Set(String::NewSymbol("cacheHits"),   Number::New(file->cacheHits));
+      stats->Set(String::NewSymbol("cacheMisses"), Number::New(file->cacheMisses));
+    }
+    return scope.Close(stats);
+  }
+
   /**********************/
   /* READ               */
   /**********************/
@@ -539,29 +1638,48 @@ public:
 
     hdfs_read_baton_t *baton = new hdfs_read_baton_t();
     baton->client = client;
+    baton->fs = client->GetFile(fh)->fs;
     baton->cb = Persistent<Function>::New(cb);
     baton->fileHandle = fileHandle;
-    baton->offset = args[1]->Int32Value();
+    baton->offset = args[1]->IntegerValue();
     baton->bufferSize = args[2]->Int32Value();
     baton->fh = fh;
+    baton->cachePath = client->GetFile(fh)->cached ? client->GetFile(fh)->path : NULL;
+    baton->codec = client->GetFile(fh)->codec;
+    baton->cacheHits = 0;
+    baton->cacheMisses = 0;
 
     client->Ref();
+    client->FileOpStart(client->GetFile(fh));
 
-    eio_custom(eio_hdfs_read, EIO_PRI_DEFAULT, eio_after_hdfs_read, baton);
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "read", work_hdfs_read, after_hdfs_read, baton);
     ev_ref(EV_DEFAULT_UC);
 
     return Undefined();
   }
 
-  static int eio_hdfs_read(eio_req *req)
+  // message for a negative read or readInto result
+  static Local<String> ReadError(tSize result)
+  {
+    return String::New(result == HdfsCodec::CORRUPT ? "Corrupt gzip stream" : "Error reading file");
+  }
+
+  static int work_hdfs_read(hdfs_work_t *req)
   {
     hdfs_read_baton_t *baton = static_cast<hdfs_read_baton_t*>(req->data);
     baton->buffer = (char *) malloc(baton->bufferSize * sizeof(char));
-    baton->readBytes = hdfsPread(baton->client->fs_, baton->fileHandle, baton->offset, baton->buffer, baton->bufferSize);
+    if(baton->codec) {
+      baton->readBytes = baton->codec->Read(baton->fs, baton->fileHandle, baton->offset, baton->buffer, baton->bufferSize);
+    } else {
+      baton->readBytes = baton->client->CachedPread(baton->fs, baton->fileHandle, baton->cachePath, baton->offset,
+                                                    baton->buffer, baton->bufferSize, &baton->cacheHits, &baton->cacheMisses);
+    }
+    req->failed = baton->readBytes < 0;
+    if(baton->readBytes > 0) req->bytes = baton->readBytes;
     return 0;
   }
 
-  static int eio_after_hdfs_read(eio_req *req)
+  static int after_hdfs_read(hdfs_work_t *req)
   {
     HandleScope scope;
 
@@ -569,14 +1687,20 @@ public:
     ev_unref(EV_DEFAULT_UC);
     baton->client->Unref();
 
-    Handle<Value> argv[1];
+    baton->client->FileOpDone(baton->fh, baton->readBytes, 0, baton->cacheHits, baton->cacheMisses);
+    baton->client->FileOpEnd(baton->fh);
+
+    Handle<Value> argv[2];
 
-    Buffer *b =  Buffer::New(baton->buffer, baton->readBytes);
+    // a failed read comes back as an empty buffer, like the end of the
+    // file, with the error as a second argument
+    Buffer *b =  Buffer::New(baton->buffer, baton->readBytes > 0 ? baton->readBytes : 0);
     argv[0] = Local<Value>::New(b->handle_);
+    argv[1] = baton->readBytes >= 0 ? Local<Value>::New(Undefined()) : Local<Value>::New(ReadError(baton->readBytes));
     free(baton->buffer);
 
     TryCatch try_catch;
-    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+    baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
 
     if (try_catch.HasCaught()) {
       FatalException(try_catch);
@@ -588,126 +1712,1619 @@ public:
   }
 
   /**********************/
-  /* WRITE              */
+  /* READ INTO          */
   /**********************/
 
-  // write(fileHandleId, buffer, cb)
-  static Handle<Value> Write(const Arguments& args)
+  // readInto(handle, offset, targetBuffer, targetOffset, length, callback)
+  // Reads straight into the memory of targetBuffer, which stays pinned by a
+  // persistent handle until the callback runs. Callback receives
+  // (err, bytesRead, targetBuffer).
+  static Handle<Value> ReadInto(const Arguments &args)
   {
     HandleScope scope;
-    REQ_FUN_ARG(2, cb);
+    REQ_FUN_ARG(5, cb);
 
     HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
     int fh = args[0]->Int32Value();
+
     hdfsFile_internal *fileHandle = client->GetFileHandle(fh);
 
     if(!fileHandle) {
       return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
     }
 
-    Local<Object> obj = args[1]->ToObject();
-    int length = Buffer::Length(obj);
-    char *buffer = (char *) malloc(length * sizeof(char));
-    strncpy(buffer, Buffer::Data(obj), length);
+    if(!Buffer::HasInstance(args[2])) {
+      return ThrowException(Exception::TypeError(String::New("Argument 2 must be a Buffer")));
+    }
+
+    Local<Object> target = args[2]->ToObject();
+    int targetOffset = args[3]->Int32Value();
+    int length = args[4]->Int32Value();
 
-    hdfs_write_baton_t *baton = new hdfs_write_baton_t();
+    if(targetOffset < 0 || length < 0 || (size_t)targetOffset + length > Buffer::Length(target)) {
+      return ThrowException(Exception::RangeError(String::New("Target range is out of the buffer bounds")));
+    }
+
+    hdfs_read_into_baton_t *baton = new hdfs_read_into_baton_t();
     baton->client = client;
+    baton->fs = client->GetFile(fh)->fs;
     baton->cb = Persistent<Function>::New(cb);
-    baton->buffer = buffer;
-    baton->bufferLength = length;
+    baton->target = Persistent<Object>::New(target);
     baton->fileHandle = fileHandle;
-    baton->writtenBytes = 0;
+    baton->offset = args[1]->IntegerValue();
+    baton->buffer = Buffer::Data(target) + targetOffset;
+    baton->length = length;
+    baton->readBytes = 0;
+    baton->fh = fh;
+    baton->cachePath = client->GetFile(fh)->cached ? client->GetFile(fh)->path : NULL;
+    baton->codec = client->GetFile(fh)->codec;
+    baton->cacheHits = 0;
+    baton->cacheMisses = 0;
 
     client->Ref();
+    client->FileOpStart(client->GetFile(fh));
 
-    eio_custom(eio_hdfs_write, EIO_PRI_DEFAULT, eio_after_hdfs_write, baton);
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "readInto", work_hdfs_read_into, after_hdfs_read_into, baton);
     ev_ref(EV_DEFAULT_UC);
 
     return Undefined();
   }
 
-  static int eio_hdfs_write(eio_req *req)
+  static int work_hdfs_read_into(hdfs_work_t *req)
   {
-    hdfs_write_baton_t *baton = static_cast<hdfs_write_baton_t*>(req->data);
-
-    baton->writtenBytes = hdfsWrite(baton->client->fs_, baton->fileHandle, (void*)baton->buffer, baton->bufferLength);
-    hdfsFlush(baton->client->fs_, baton->fileHandle);
-
+    hdfs_read_into_baton_t *baton = static_cast<hdfs_read_into_baton_t*>(req->data);
+    if(baton->codec) {
+      baton->readBytes = baton->codec->Read(baton->fs, baton->fileHandle, baton->offset, baton->buffer, baton->length);
+    } else {
+      baton->readBytes = baton->client->CachedPread(baton->fs, baton->fileHandle, baton->cachePath, baton->offset,
+                                                    baton->buffer, baton->length, &baton->cacheHits, &baton->cacheMisses);
+    }
+    req->failed = baton->readBytes < 0;
+    if(baton->readBytes > 0) req->bytes = baton->readBytes;
     return 0;
   }
 
-  static int eio_after_hdfs_write(eio_req *req)
+  static int after_hdfs_read_into(hdfs_work_t *req)
   {
     HandleScope scope;
-    hdfs_write_baton_t *baton = static_cast<hdfs_write_baton_t*>(req->data);
 
+    hdfs_read_into_baton_t *baton = static_cast<hdfs_read_into_baton_t*>(req->data);
     ev_unref(EV_DEFAULT_UC);
     baton->client->Unref();
 
-    Local<Value> argv[1];
-    argv[0] = Integer::New(baton->writtenBytes);
+    baton->client->FileOpDone(baton->fh, baton->readBytes, 0, baton->cacheHits, baton->cacheMisses);
+    baton->client->FileOpEnd(baton->fh);
 
-    TryCatch try_catch;
+    Handle<Value> argv[3];
 
-    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+    if(baton->readBytes >= 0) {
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = Local<Value>::New(Integer::New(baton->readBytes));
+    } else {
+      argv[0] = Local<Value>::New(ReadError(baton->readBytes));
+      argv[1] = Local<Value>::New(Integer::New(0));
+    }
+    argv[2] = Local<Value>::New(baton->target);
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 3, argv);
 
     if (try_catch.HasCaught()) {
       FatalException(try_catch);
     }
 
     baton->cb.Dispose();
-
-    free(baton->buffer);
+    baton->target.Dispose();
     delete baton;
     return 0;
   }
-  
-  /*** Create Directory ***/
-  
-  static Handle<Value> CreateDirectory(const Arguments& args)
-  {
-    return genericPathOp(eio_hdfs_mkdir, args);
-  }
 
-  static int eio_hdfs_mkdir(eio_req *req)
-  {
-    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
-    baton->result = hdfsCreateDirectory(baton->client->fs_, baton->filePath);
-    return 0;
-  }
+  /**********************/
+  /* READV              */
+  /**********************/
 
-  /*** exists ***/
-  
-  static Handle<Value> Exists(const Arguments& args)
-  {
-    return genericPathOp(eio_hdfs_exists, args);
-  }
+  // ranges further apart than this are read separately
+  static const int READV_DEFAULT_GAP = 64 * 1024;
+  // merging stops once a read would grow past this, to keep reads parallel
+  static const int READV_MAX_MERGED = 4 * 1024 * 1024;
 
-  static int eio_hdfs_exists(eio_req *req)
-  {
-    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
-    baton->result = hdfsExists(baton->client->fs_, baton->filePath);
-    return 0;
-  }
+  struct hdfs_readv_range_t {
+    tOffset offset;
+    int length;
+    int index;   // position in the caller's array
+    int read;    // merged read that covers it
+  };
 
-  /*** delete ***/
-  
-  static Handle<Value> Delete(const Arguments& args)
+  struct hdfs_readv_read_t {
+    tOffset offset;
+    int length;
+    size_t bufferOffset;
+    int readBytes;
+  };
+
+  struct hdfs_readv_baton_t {
+    HdfsClient *client;
+    hdfsFS fs;
+    int fh;
+    hdfsFile_internal *fileHandle;
+    const char *cachePath;
+    Persistent<Function> cb;
+    Persistent<Object> buffer;
+    char *data;
+    std::vector<hdfs_readv_range_t> ranges;   // sorted by offset
+    std::vector<hdfs_readv_read_t> reads;
+    int parallel;
+    int next;
+    int inflight;
+    int cacheHits;
+    int cacheMisses;
+  };
+
+  struct hdfs_readv_req_t {
+    hdfs_readv_baton_t *readv;
+    int read;
+    int cacheHits;
+    int cacheMisses;
+  };
+
+  static bool readv_range_before(const hdfs_readv_range_t &a, const hdfs_readv_range_t &b)
   {
-    return genericPathOp(eio_hdfs_delete, args);
+    return a.offset < b.offset;
   }
 
-  static int eio_hdfs_delete(eio_req *req)
+  // readv(handle, [[offset, length], ...], [options], callback)
+  // options: { gap, parallel }
+  // Ranges closer than gap bytes (default 64 KB) are merged, and the merged
+  // reads run parallel (default 4) at a time into one Buffer. Callback
+  // receives (err, buffer, [[start, length], ...]) with the position in
+  // buffer of each requested range, in the order given; length is short at
+  // the end of the file.
+  static Handle<Value> Readv(const Arguments &args)
   {
-    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
-    baton->result = hdfsDelete(baton->client->fs_, baton->filePath);
+    HandleScope scope;
+    int cbIndex = args[2]->IsFunction() ? 2 : 3;
+    REQ_FUN_ARG(cbIndex, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    int fh = args[0]->Int32Value();
+    hdfs_file_t *file = client->GetFile(fh);
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+    if(file->codec) {
+      return ThrowException(Exception::TypeError(String::New("Compressed files can only be read sequentially")));
+    }
+    if(!args[1]->IsArray()) {
+      return ThrowException(Exception::TypeError(String::New("Argument 1 must be an array of [offset, length] ranges")));
+    }
+
+    int gap = READV_DEFAULT_GAP;
+    int parallel = 4;
+    if(cbIndex == 3 && args[2]->IsObject()) {
+      Local<Object> options = args[2]->ToObject();
+      Local<Value> value;
+      if((value = options->Get(String::NewSymbol("gap")))->IsNumber()) gap = value->Int32Value();
+      if((value = options->Get(String::NewSymbol("parallel")))->IsNumber()) parallel = value->Int32Value();
+    }
+
+    Local<Array> rangeArray = Local<Array>::Cast(args[1]);
+    std::vector<hdfs_readv_range_t> ranges(rangeArray->Length());
+    for(size_t i=0; i<ranges.size(); i++) {
+      Local<Value> range = rangeArray->Get(i);
+      if(!range->IsArray()) {
+        return ThrowException(Exception::TypeError(String::New("Argument 1 must be an array of [offset, length] ranges")));
+      }
+      ranges[i].offset = range->ToObject()->Get(0)->IntegerValue();
+      ranges[i].length = range->ToObject()->Get(1)->Int32Value();
+      ranges[i].index = i;
+      if(ranges[i].offset < 0 || ranges[i].length < 0) {
+        return ThrowException(Exception::RangeError(String::New("Range offset and length must not be negative")));
+      }
+    }
+    std::sort(ranges.begin(), ranges.end(), readv_range_before);
+
+    // merge, then lay the merged reads out back to back in one buffer
+    std::vector<hdfs_readv_read_t> reads;
+    size_t total = 0;
+    for(size_t i=0; i<ranges.size(); i++) {
+      tOffset end = ranges[i].offset + ranges[i].length;
+      if(!reads.empty()) {
+        hdfs_readv_read_t &last = reads.back();
+        tOffset lastEnd = last.offset + last.length;
+        if(ranges[i].offset <= lastEnd + gap && std::max(end, lastEnd) - last.offset <= READV_MAX_MERGED) {
+          if(end > lastEnd) {
+            total += end - lastEnd;
+            last.length = end - last.offset;
+          }
+          ranges[i].read = reads.size() - 1;
+          continue;
+        }
+      }
+      hdfs_readv_read_t read;
+      read.offset = ranges[i].offset;
+      read.length = ranges[i].length;
+      read.bufferOffset = total;
+      read.readBytes = 0;
+      total += read.length;
+      reads.push_back(read);
+      ranges[i].read = reads.size() - 1;
+    }
+
+    Buffer *buffer = Buffer::New(total);
+
+    hdfs_readv_baton_t *baton = new hdfs_readv_baton_t();
+    baton->client = client;
+    baton->fs = file->fs;
+    baton->fh = fh;
+    baton->fileHandle = file->file;
+    baton->cachePath = file->cached ? file->path : NULL;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->buffer = Persistent<Object>::New(buffer->handle_);
+    baton->data = Buffer::Data(buffer->handle_);
+    baton->ranges.swap(ranges);
+    baton->reads.swap(reads);
+    baton->parallel = parallel > 0 ? parallel : 1;
+    baton->next = 0;
+    baton->inflight = 0;
+    baton->cacheHits = 0;
+    baton->cacheMisses = 0;
+
+    client->Ref();
+    client->FileOpStart(file);
+    ReadvPump(baton);
+
+    return Undefined();
+  }
+
+  static void ReadvPump(hdfs_readv_baton_t *readv)
+  {
+    int count = readv->reads.size();
+    // no ranges still goes through the pool once so the callback is never synchronous
+    bool empty = count == 0 && readv->inflight == 0;
+    while(readv->inflight < readv->parallel && (readv->next < count || empty)) {
+      empty = false;
+      hdfs_readv_req_t *req = new hdfs_readv_req_t();
+      req->readv = readv;
+      req->read = readv->next < count ? readv->next++ : -1;
+      req->cacheHits = 0;
+      req->cacheMisses = 0;
+      readv->inflight++;
+
+      HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "readv", work_hdfs_readv, after_hdfs_readv, req);
+      ev_ref(EV_DEFAULT_UC);
+    }
+  }
+
+  static int work_hdfs_readv(hdfs_work_t *req)
+  {
+    hdfs_readv_req_t *readvReq = static_cast<hdfs_readv_req_t*>(req->data);
+    if(readvReq->read < 0) return 0;
+
+    hdfs_readv_baton_t *readv = readvReq->readv;
+    hdfs_readv_read_t &read = readv->reads[readvReq->read];
+    char *buffer = readv->data + read.bufferOffset;
+
+    // hdfsPread may return less than asked before the end of the file
+    while(read.readBytes < read.length) {
+      tSize n = readv->client->CachedPread(readv->fs, readv->fileHandle, readv->cachePath,
+                                           read.offset + read.readBytes, buffer + read.readBytes,
+                                           read.length - read.readBytes,
+                                           &readvReq->cacheHits, &readvReq->cacheMisses);
+      if(n < 0) {
+        read.readBytes = -1;
+        break;
+      }
+      if(n == 0) break;
+      read.readBytes += n;
+    }
+    req->failed = read.readBytes < 0;
+    if(read.readBytes > 0) req->bytes = read.readBytes;
+    return 0;
+  }
+
+  static int after_hdfs_readv(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_readv_req_t *readvReq = static_cast<hdfs_readv_req_t*>(req->data);
+    hdfs_readv_baton_t *readv = readvReq->readv;
+
+    ev_unref(EV_DEFAULT_UC);
+    readv->inflight--;
+    readv->cacheHits += readvReq->cacheHits;
+    readv->cacheMisses += readvReq->cacheMisses;
+    delete readvReq;
+
+    if(readv->inflight > 0 || readv->next < (int)readv->reads.size()) {
+      ReadvPump(readv);
+      return 0;
+    }
+
+    bool failed = false;
+    double readBytes = 0;
+    for(size_t i=0; i<readv->reads.size(); i++) {
+      if(readv->reads[i].readBytes < 0) failed = true;
+      else readBytes += readv->reads[i].readBytes;
+    }
+    readv->client->FileOpDone(readv->fh, readBytes, 0, readv->cacheHits, readv->cacheMisses);
+    readv->client->FileOpEnd(readv->fh);
+
+    Handle<Value> argv[3];
+    if(failed) {
+      argv[0] = Local<Value>::New(String::New("Error reading file"));
+      argv[1] = Local<Value>::New(Undefined());
+      argv[2] = Local<Value>::New(Undefined());
+    } else {
+      Local<Array> positions = Array::New(readv->ranges.size());
+      for(size_t i=0; i<readv->ranges.size(); i++) {
+        hdfs_readv_range_t &range = readv->ranges[i];
+        hdfs_readv_read_t &read = readv->reads[range.read];
+        int within = range.offset - read.offset;
+        int length = std::max(0, std::min(range.length, read.readBytes - within));
+
+        Local<Array> position = Array::New(2);
+        position->Set(0, Integer::New(read.bufferOffset + within));
+        position->Set(1, Integer::New(length));
+        positions->Set(range.index, position);
+      }
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = Local<Value>::New(readv->buffer);
+      argv[2] = positions;
+    }
+
+    TryCatch try_catch;
+    readv->cb->Call(Context::GetCurrent()->Global(), 3, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    readv->client->Unref();
+    readv->cb.Dispose();
+    readv->buffer.Dispose();
+    delete readv;
+    return 0;
+  }
+
+  /**********************/
+  /* RECORDS            */
+  /**********************/
+
+  struct hdfs_records_baton_t {
+    HdfsClient *client;
+    hdfsFS fs;
+    int fh;
+    hdfsFile_internal *fileHandle;
+    const char *cachePath;
+    Persistent<Function> cb;
+    tOffset offset;
+    tOffset end;           // records starting after it belong to the next split; -1 for none
+    bool skipFirst;
+    int bufferSize;
+    char *delimiter;       // NULL for "\n", with a "\r" before it dropped too
+    int delimiterLength;
+    int recordLength;      // fixed-length records when > 0
+    char *data;
+    int length;
+    std::vector<uint32_t> positions;   // start, length pairs into data
+    tOffset nextOffset;
+    bool done;
+    bool failed;
+    int cacheHits;
+    int cacheMisses;
+  };
+
+  // readRecords(handle, offset, options, callback)
+  // options: { delimiter, recordLength, end, skipFirst, bufferSize }
+  // Reads bufferSize bytes (default 1 MB, more if a single record is longer)
+  // at offset and splits them into records on the worker thread. Callback
+  // receives (err, buffer, positions, nextOffset, done): positions is a
+  // Buffer of uint32 (start, length) pairs into buffer, one per complete
+  // record, and reading continues at nextOffset. Like Hadoop's
+  // TextInputFormat, with skipFirst the partial record at offset is skipped
+  // (it belongs to the previous split), and a record is returned as long as
+  // it starts at or before end. Fixed-length records start at multiples of
+  // recordLength, before end; the last one may be short.
+  static Handle<Value> ReadRecords(const Arguments &args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(3, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    int fh = args[0]->Int32Value();
+    hdfs_file_t *file = client->GetFile(fh);
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+    if(file->codec) {
+      return ThrowException(Exception::TypeError(String::New("Compressed files can only be read sequentially")));
+    }
+
+    hdfs_records_baton_t *baton = new hdfs_records_baton_t();
+    baton->client = client;
+    baton->fs = file->fs;
+    baton->fh = fh;
+    baton->fileHandle = file->file;
+    baton->cachePath = file->cached ? file->path : NULL;
+    baton->offset = args[1]->IntegerValue();
+    baton->end = -1;
+    baton->skipFirst = false;
+    baton->bufferSize = 1024 * 1024;
+    baton->delimiter = NULL;
+    baton->delimiterLength = 1;
+    baton->recordLength = 0;
+    baton->data = NULL;
+    baton->length = 0;
+    baton->nextOffset = baton->offset;
+    baton->done = false;
+    baton->failed = false;
+    baton->cacheHits = 0;
+    baton->cacheMisses = 0;
+
+    if(args[2]->IsObject()) {
+      Local<Object> options = args[2]->ToObject();
+      Local<Value> value;
+      if((value = options->Get(String::NewSymbol("end")))->IsNumber()) baton->end = value->IntegerValue();
+      if((value = options->Get(String::NewSymbol("bufferSize")))->IsNumber()) baton->bufferSize = value->Int32Value();
+      if((value = options->Get(String::NewSymbol("recordLength")))->IsNumber()) baton->recordLength = value->Int32Value();
+      baton->skipFirst = options->Get(String::NewSymbol("skipFirst"))->BooleanValue();
+      if((value = options->Get(String::NewSymbol("delimiter")))->IsString()) {
+        v8::String::Utf8Value delimiterStr(value);
+        if(delimiterStr.length() > 0) {
+          baton->delimiter = strdup(*delimiterStr);
+          baton->delimiterLength = delimiterStr.length();
+        }
+      }
+    }
+    if(baton->bufferSize < 1024) baton->bufferSize = 1024;
+    if(baton->bufferSize < 2 * baton->delimiterLength) baton->bufferSize = 2 * baton->delimiterLength;
+    if(baton->recordLength > 0 && baton->bufferSize < baton->recordLength) baton->bufferSize = baton->recordLength;
+
+    baton->cb = Persistent<Function>::New(cb);
+    client->Ref();
+    client->FileOpStart(file);
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "readRecords", work_hdfs_records, after_hdfs_records, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  // fills up to length bytes unless the file ends first; -1 on error
+  static tSize RecordsRead(hdfs_records_baton_t *baton, tOffset offset, char *buffer, tSize length)
+  {
+    tSize total = 0;
+    while(total < length) {
+      tSize n = baton->client->CachedPread(baton->fs, baton->fileHandle, baton->cachePath, offset + total,
+                                           buffer + total, length - total, &baton->cacheHits, &baton->cacheMisses);
+      if(n < 0) return -1;
+      if(n == 0) break;
+      total += n;
+    }
+    return total;
+  }
+
+  // memchr (vectorized in libc) for the first delimiter byte, then the rest
+  static const char *FindDelimiter(const char *data, int length, const char *delimiter, int delimiterLength)
+  {
+    const char *end = data + length;
+    while(data + delimiterLength <= end) {
+      const char *found = (const char *) memchr(data, delimiter[0], end - data - delimiterLength + 1);
+      if(!found || delimiterLength == 1 || !memcmp(found + 1, delimiter + 1, delimiterLength - 1)) return found;
+      data = found + 1;
+    }
+    return NULL;
+  }
+
+  static int work_hdfs_records(hdfs_work_t *req)
+  {
+    hdfs_records_baton_t *baton = static_cast<hdfs_records_baton_t*>(req->data);
+    baton->recordLength > 0 ? FixedRecords(baton) : DelimitedRecords(baton);
+    req->failed = baton->failed;
+    req->bytes = baton->length;
+    return 0;
+  }
+
+  static int FixedRecords(hdfs_records_baton_t *baton)
+  {
+    tOffset recordLength = baton->recordLength;
+    tOffset pos = (baton->offset + recordLength - 1) / recordLength * recordLength;
+    int size = baton->bufferSize - baton->bufferSize % recordLength;
+
+    baton->data = (char *) malloc(size);
+    tSize n = RecordsRead(baton, pos, baton->data, size);
+    if(n < 0) {
+      baton->failed = true;
+      return 0;
+    }
+    baton->length = n;
+
+    tSize s = 0;
+    while(s < n && (baton->end < 0 || pos + s < baton->end)) {
+      baton->positions.push_back(s);
+      baton->positions.push_back(std::min((tSize)recordLength, n - s));
+      s += recordLength;
+    }
+    baton->nextOffset = pos + std::min(s, n);
+    baton->done = n < size || (baton->end >= 0 && baton->nextOffset >= baton->end);
+    return 0;
+  }
+
+  static int DelimitedRecords(hdfs_records_baton_t *baton)
+  {
+    const char *delimiter = baton->delimiter ? baton->delimiter : "\n";
+    int delimiterLength = baton->delimiterLength;
+    tOffset pos = baton->offset;
+    int size = baton->bufferSize;
+    char *data = (char *) malloc(size);
+
+    // skip to the start of the first record that begins after offset, which
+    // may be right after a delimiter that straddles it
+    if(baton->skipFirst) pos = std::max((tOffset) 0, pos - (delimiterLength - 1));
+    while(baton->skipFirst) {
+      tSize n = RecordsRead(baton, pos, data, size);
+      if(n < 0) baton->failed = true;
+      if(n <= 0) baton->done = true;
+      if(n <= 0 || (baton->end >= 0 && pos > baton->end)) break;
+
+      const char *found = FindDelimiter(data, n, delimiter, delimiterLength);
+      if(found) {
+        pos += found - data + delimiterLength;
+        break;
+      }
+      if(n < size) {
+        baton->done = true;
+        break;
+      }
+      pos += n - (delimiterLength - 1);
+    }
+
+    if(baton->done || (baton->end >= 0 && pos > baton->end)) {
+      free(data);
+      baton->nextOffset = pos;
+      baton->done = true;
+      return 0;
+    }
+
+    tSize n = RecordsRead(baton, pos, data, size);
+    if(n < 0) {
+      free(data);
+      baton->failed = true;
+      return 0;
+    }
+    bool eof = n < size;
+
+    tSize s = 0;
+    while(true) {
+      if(baton->end >= 0 && pos + s > baton->end) {
+        baton->done = true;
+        break;
+      }
+      if(s >= n) {
+        baton->done = eof;
+        break;
+      }
+
+      const char *found = FindDelimiter(data + s, n - s, delimiter, delimiterLength);
+      if(found) {
+        tSize length = found - (data + s);
+        if(!baton->delimiter && length > 0 && data[s + length - 1] == '\r') length--;
+        baton->positions.push_back(s);
+        baton->positions.push_back(length);
+        s = found - data + delimiterLength;
+      } else if(eof) {
+        // the last record needs no delimiter
+        baton->positions.push_back(s);
+        baton->positions.push_back(n - s);
+        s = n;
+      } else if(baton->positions.empty()) {
+        // a record longer than the buffer: read on until it ends
+        data = (char *) realloc(data, size * 2);
+        tSize more = RecordsRead(baton, pos + n, data + n, size * 2 - n);
+        if(more < 0) {
+          baton->failed = true;
+          break;
+        }
+        eof = n + more < size * 2;
+        n += more;
+        size *= 2;
+      } else {
+        break;
+      }
+    }
+
+    baton->data = data;
+    baton->length = n;
+    baton->nextOffset = pos + s;
+    return 0;
+  }
+
+  static int after_hdfs_records(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_records_baton_t *baton = static_cast<hdfs_records_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+    baton->client->FileOpDone(baton->fh, baton->failed ? 0 : baton->length, 0, baton->cacheHits, baton->cacheMisses);
+    baton->client->FileOpEnd(baton->fh);
+
+    Handle<Value> argv[5];
+    if(baton->failed) {
+      argv[0] = Local<Value>::New(String::New("Error reading file"));
+      argv[1] = Local<Value>::New(Undefined());
+      argv[2] = Local<Value>::New(Undefined());
+      argv[3] = Local<Value>::New(Undefined());
+      argv[4] = Local<Value>::New(True());
+    } else {
+      Buffer *data = Buffer::New(baton->data ? baton->data : (char *) "", baton->length);
+      Buffer *positions = Buffer::New(baton->positions.empty() ? (char *) "" : (char *) &baton->positions[0],
+                                      baton->positions.size() * sizeof(uint32_t));
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = Local<Value>::New(data->handle_);
+      argv[2] = Local<Value>::New(positions->handle_);
+      argv[3] = Local<Value>::New(Number::New(baton->nextOffset));
+      argv[4] = Local<Value>::New(Boolean::New(baton->done));
+    }
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 5, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    free(baton->data);
+    free(baton->delimiter);
+    delete baton;
+    return 0;
+  }
+
+  /**********************/
+  /* COPY / MOVE        */
+  /**********************/
+
+  struct hdfs_transfer_baton_t {
+    HdfsClient *client;
+    hdfs_conn_t *conn;
+    HdfsClient *dstClient;
+    hdfs_conn_t *dstConn;
+    char *src;
+    char *dst;
+    bool move;
+    Persistent<Function> cb;
+    int result;
+  };
+
+  // copy(src, dstClient, dst, cb) and move(src, dstClient, dst, cb) - dst is
+  // on dstClient's filesystem, or on this one when dstClient is null. The
+  // data goes through libhdfs (FileUtil.copy), on a data worker, without
+  // being handed to node. Callback receives (err).
+  static Handle<Value> Copy(const Arguments &args)
+  {
+    return Transfer(args, false);
+  }
+
+  static Handle<Value> Move(const Arguments &args)
+  {
+    return Transfer(args, true);
+  }
+
+  static Handle<Value> Transfer(const Arguments &args, bool move)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(3, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    HdfsClient* dstClient = client;
+    if(args[1]->IsObject()) {
+      if(!s_ct->HasInstance(args[1])) {
+        return ThrowException(Exception::TypeError(String::New("Argument 1 must be an HDFS client or null")));
+      }
+      dstClient = ObjectWrap::Unwrap<HdfsClient>(args[1]->ToObject());
+    }
+
+    v8::String::Utf8Value srcStr(args[0]);
+    v8::String::Utf8Value dstStr(args[2]);
+
+    hdfs_transfer_baton_t *baton = new hdfs_transfer_baton_t();
+    baton->client = client;
+    baton->conn = client->pool_.Acquire();
+    baton->dstClient = dstClient;
+    baton->dstConn = dstClient == client ? baton->conn : dstClient->pool_.Acquire();
+    baton->src = strdup(*srcStr);
+    baton->dst = strdup(*dstStr);
+    baton->move = move;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->result = -1;
+
+    client->Ref();
+    if(dstClient != client) dstClient->Ref();
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, move ? "move" : "copy", work_hdfs_transfer, after_hdfs_transfer, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_transfer(hdfs_work_t *req)
+  {
+    hdfs_transfer_baton_t *baton = static_cast<hdfs_transfer_baton_t*>(req->data);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    hdfsFS dstFs = baton->dstConn == baton->conn ? fs : baton->dstClient->pool_.Get(baton->dstConn);
+
+    if(fs && dstFs) {
+      baton->result = baton->move ? hdfsMove(fs, baton->src, dstFs, baton->dst)
+                                  : hdfsCopy(fs, baton->src, dstFs, baton->dst);
+    }
+    if(baton->result != 0) {
+      int err = errno;
+      baton->client->pool_.Failed(baton->conn, fs);
+      errno = err;
+      if(dstFs != fs) baton->dstClient->pool_.Failed(baton->dstConn, dstFs);
+    }
+    if(baton->move) baton->client->PathChanged(baton->src);
+    baton->dstClient->PathChanged(baton->dst);
+    req->failed = baton->result != 0;
+    return 0;
+  }
+
+  static int after_hdfs_transfer(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_transfer_baton_t *baton = static_cast<hdfs_transfer_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->pool_.Release(baton->conn);
+    baton->client->Unref();
+    if(baton->dstClient != baton->client) {
+      baton->dstClient->pool_.Release(baton->dstConn);
+      baton->dstClient->Unref();
+    }
+
+    Handle<Value> argv[1];
+    if(baton->result == 0) {
+      argv[0] = Local<Value>::New(Undefined());
+    } else {
+      argv[0] = Local<Value>::New(String::New(baton->move ? "Error moving file" : "Error copying file"));
+    }
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    free(baton->src);
+    free(baton->dst);
+    delete baton;
+    return 0;
+  }
+
+  /**********************/
+  /* SEEK / TELL        */
+  /**********************/
+
+  // seek(handle, offset, callback) - callback receives (err)
+  static Handle<Value> Seek(const Arguments &args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(2, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    hdfs_file_t *file = client->GetFile(args[0]->Int32Value());
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+
+    hdfs_seek_baton_t *baton = new hdfs_seek_baton_t();
+    baton->client = client;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->fh = args[0]->Int32Value();
+    baton->fs = file->fs;
+    baton->fileHandle = file->file;
+    baton->offset = args[1]->IntegerValue();
+    baton->result = -1;
+
+    client->Ref();
+    client->FileOpStart(file);
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "seek", work_hdfs_seek, after_hdfs_seek, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_seek(hdfs_work_t *req)
+  {
+    hdfs_seek_baton_t *baton = static_cast<hdfs_seek_baton_t*>(req->data);
+    baton->result = hdfsSeek(baton->fs, baton->fileHandle, baton->offset);
+    req->failed = baton->result != 0;
+    return 0;
+  }
+
+  static int after_hdfs_seek(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_seek_baton_t *baton = static_cast<hdfs_seek_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+    baton->client->FileOpEnd(baton->fh);
+
+    Local<Value> argv[1];
+    argv[0] = baton->result == 0 ? Local<Value>::New(Undefined()) : Local<Value>::New(String::New("Error seeking file"));
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete baton;
+    return 0;
+  }
+
+  // tell(handle, callback) - callback receives (err, offset)
+  static Handle<Value> Tell(const Arguments &args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(1, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    hdfs_file_t *file = client->GetFile(args[0]->Int32Value());
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+
+    hdfs_seek_baton_t *baton = new hdfs_seek_baton_t();
+    baton->client = client;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->fh = args[0]->Int32Value();
+    baton->fs = file->fs;
+    baton->fileHandle = file->file;
+    baton->offset = -1;
+    baton->result = -1;
+
+    client->Ref();
+    client->FileOpStart(file);
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "tell", work_hdfs_tell, after_hdfs_tell, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_tell(hdfs_work_t *req)
+  {
+    hdfs_seek_baton_t *baton = static_cast<hdfs_seek_baton_t*>(req->data);
+    baton->offset = hdfsTell(baton->fs, baton->fileHandle);
+    baton->result = baton->offset < 0 ? -1 : 0;
+    req->failed = baton->result != 0;
+    return 0;
+  }
+
+  static int after_hdfs_tell(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_seek_baton_t *baton = static_cast<hdfs_seek_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+    baton->client->FileOpEnd(baton->fh);
+
+    Local<Value> argv[2];
+    if(baton->result == 0) {
+      argv[0] = Local<Value>::New(Undefined());
+      argv[1] = Local<Value>::New(Number::New((double)baton->offset));
+    } else {
+      argv[0] = Local<Value>::New(String::New("Error reading file position"));
+      argv[1] = Local<Value>::New(Undefined());
+    }
+
+    TryCatch try_catch;
+    baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete baton;
+    return 0;
+  }
+
+  /**********************/
+  /* WRITE              */
+  /**********************/
+
+  // write(fileHandleId, buffer, cb)
+  // write(fileHandleId, [buffer, ...], cb)
+  // The buffers are not copied: they stay pinned by a persistent handle and
+  // their memory is handed to hdfsWrite directly on the worker thread.
+  static Handle<Value> Write(const Arguments& args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(2, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    int fh = args[0]->Int32Value();
+    hdfs_file_t *file = client->GetFile(fh);
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+
+    int chunkCount;
+    Local<Array> list;
+
+    if(args[1]->IsArray()) {
+      list = Local<Array>::Cast(args[1]);
+      chunkCount = list->Length();
+      for(int i=0; i<chunkCount; i++) {
+        if(!Buffer::HasInstance(list->Get(i))) {
+          return ThrowException(Exception::TypeError(String::New("Argument 1 must be a Buffer or an array of Buffers")));
+        }
+      }
+    } else if(Buffer::HasInstance(args[1])) {
+      chunkCount = 1;
+    } else {
+      return ThrowException(Exception::TypeError(String::New("Argument 1 must be a Buffer or an array of Buffers")));
+    }
+
+    hdfs_write_baton_t *baton = new hdfs_write_baton_t();
+    baton->client = client;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->buffers = Persistent<Object>::New(args[1]->ToObject());
+    baton->chunks = new hdfs_write_chunk_t[chunkCount];
+    baton->chunkCount = chunkCount;
+    baton->fh = fh;
+    baton->file = file;
+    baton->writtenBytes = 0;
+
+    for(int i=0; i<chunkCount; i++) {
+      Local<Object> obj = args[1]->IsArray() ? list->Get(i)->ToObject() : args[1]->ToObject();
+      baton->chunks[i].data = Buffer::Data(obj);
+      baton->chunks[i].length = Buffer::Length(obj);
+    }
+
+    client->Ref();
+    client->FileOpStart(file);
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "write", work_hdfs_write, after_hdfs_write, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_write(hdfs_work_t *req)
+  {
+    hdfs_write_baton_t *baton = static_cast<hdfs_write_baton_t*>(req->data);
+
+    pthread_mutex_lock(&baton->file->writeLock);
+    for(int i=0; i<baton->chunkCount; i++) {
+      if(baton->chunks[i].length == 0) continue;
+      hdfs_file_t *file = baton->file;
+      tSize written = file->codec ? file->codec->Write(file->fs, file->file, baton->chunks[i].data, baton->chunks[i].length)
+                                  : hdfsWrite(file->fs, file->file, (void*)baton->chunks[i].data, baton->chunks[i].length);
+      if(written < 0) {
+        baton->writtenBytes = -1;
+        break;
+      }
+      baton->writtenBytes += written;
+    }
+
+    hdfs_file_t *file = baton->file;
+    if(baton->writtenBytes > 0) file->unflushedBytes += baton->writtenBytes;
+    if(NeedsFlush(file)) {
+      if(file->codec) file->codec->Flush(file->fs, file->file, false);
+      hdfsFlush(file->fs, file->file);
+      file->unflushedBytes = 0;
+      file->lastFlush = now_ms();
+      baton->client->PathChanged(file->path);
+    }
+    pthread_mutex_unlock(&file->writeLock);
+
+    req->failed = baton->writtenBytes < 0;
+    if(baton->writtenBytes > 0) req->bytes = baton->writtenBytes;
+    return 0;
+  }
+
+  static bool NeedsFlush(hdfs_file_t *file)
+  {
+    switch(file->flushPolicy) {
+      case FLUSH_WRITE:    return true;
+      case FLUSH_BYTES:    return file->unflushedBytes >= file->flushBytes;
+      case FLUSH_INTERVAL: return file->unflushedBytes > 0 && now_ms() - file->lastFlush >= file->flushInterval;
+      default:             return false;
+    }
+  }
+
+  /**********************/
+  /* FLUSH / SYNC       */
+  /**********************/
+
+  // flush(fileHandleId, cb) / sync(fileHandleId, cb)
+  // Callback receives (err). sync is an alias of flush: this libhdfs has no
+  // hsync/hflush, only hdfsFlush, which pushes the buffered data to the
+  // datanodes but does not wait for them to reach the disk.
+  static Handle<Value> Flush(const Arguments& args)
+  {
+    return flushOp(args);
+  }
+
+  static Handle<Value> Sync(const Arguments& args)
+  {
+    return flushOp(args);
+  }
+
+  static Handle<Value> flushOp(const Arguments& args)
+  {
+    HandleScope scope;
+    REQ_FUN_ARG(1, cb);
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    hdfs_file_t *file = client->GetFile(args[0]->Int32Value());
+
+    if(!file) {
+      return ThrowException(Exception::TypeError(String::New("Invalid file handle")));
+    }
+
+    hdfs_flush_baton_t *baton = new hdfs_flush_baton_t();
+    baton->client = client;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->fh = args[0]->Int32Value();
+    baton->file = file;
+    baton->result = -1;
+
+    client->Ref();
+    client->FileOpStart(file);
+
+    HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::DATA, "flush", work_hdfs_flush, after_hdfs_flush, baton);
+    ev_ref(EV_DEFAULT_UC);
+
+    return Undefined();
+  }
+
+  static int work_hdfs_flush(hdfs_work_t *req)
+  {
+    hdfs_flush_baton_t *baton = static_cast<hdfs_flush_baton_t*>(req->data);
+    hdfs_file_t *file = baton->file;
+    pthread_mutex_lock(&file->writeLock);
+    baton->result = file->codec ? file->codec->Flush(file->fs, file->file, false) : 0;
+    if(baton->result == 0) baton->result = hdfsFlush(file->fs, file->file);
+    if(baton->result == 0) {
+      file->unflushedBytes = 0;
+      file->lastFlush = now_ms();
+      baton->client->PathChanged(file->path);
+    }
+    pthread_mutex_unlock(&file->writeLock);
+    req->failed = baton->result != 0;
+    return 0;
+  }
+
+  static int after_hdfs_flush(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_flush_baton_t *baton = static_cast<hdfs_flush_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+    baton->client->FileOpEnd(baton->fh);
+
+    Local<Value> argv[1];
+    argv[0] = baton->result == 0 ? Local<Value>::New(Undefined()) : Local<Value>::New(String::New("Error flushing file"));
+
+    TryCatch try_catch;
+
+    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    delete baton;
+    return 0;
+  }
+
+  static int after_hdfs_write(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_write_baton_t *baton = static_cast<hdfs_write_baton_t*>(req->data);
+
+    ev_unref(EV_DEFAULT_UC);
+    baton->client->Unref();
+
+    baton->client->FileOpDone(baton->fh, 0, baton->writtenBytes);
+    baton->client->FileOpEnd(baton->fh);
+
+    Local<Value> argv[1];
+    argv[0] = Integer::New(baton->writtenBytes);
+
+    TryCatch try_catch;
+
+    baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    baton->cb.Dispose();
+    baton->buffers.Dispose();
+
+    delete [] baton->chunks;
+    delete baton;
+    return 0;
+  }
+  
+  /*** Create Directory ***/
+  
+  static Handle<Value> CreateDirectory(const Arguments& args)
+  {
+    return genericPathOp("mkdir", work_hdfs_mkdir, args);
+  }
+
+  // result is 0 once created, 1 if the path already exists (hdfsCreateDirectory
+  // would succeed on it), -1 on error
+  static int work_hdfs_mkdir(hdfs_work_t *req)
+  {
+    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs && baton->client->PathExists(fs, baton->filePath) == 0) {
+      baton->result = 1;
+      return 0;
+    }
+    if(fs) baton->result = hdfsCreateDirectory(fs, baton->filePath);
+    req->failed = baton->result != 0;
+    if(req->failed) baton->client->pool_.Failed(baton->conn, fs);
+    baton->client->PathChanged(baton->filePath);
+    return 0;
+  }
+
+  /*** exists ***/
+  
+  static Handle<Value> Exists(const Arguments& args)
+  {
+    return genericPathOp("exists", work_hdfs_exists, args);
+  }
+
+  static int work_hdfs_exists(hdfs_work_t *req)
+  {
+    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs) baton->result = baton->client->PathExists(fs, baton->filePath);
+    req->failed = !fs;
+    if(baton->result != 0) baton->client->pool_.Failed(baton->conn, fs);
+    return 0;
+  }
+
+  /*** delete ***/
+  
+  static Handle<Value> Delete(const Arguments& args)
+  {
+    return genericPathOp("delete", work_hdfs_delete, args);
+  }
+
+  static int work_hdfs_delete(hdfs_work_t *req)
+  {
+    hdfs_path_baton_t *baton = static_cast<hdfs_path_baton_t*>(req->data);
+    hdfsFS fs = baton->client->pool_.Get(baton->conn);
+    if(fs) baton->result = hdfsDelete(fs, baton->filePath);
+    req->failed = baton->result != 0;
+    if(req->failed) baton->client->pool_.Failed(baton->conn, fs);
+    baton->client->PathChanged(baton->filePath);
+    return 0;
+  }
+
+  /*** block cache ***/
+
+  // Called on a worker thread once path was changed through this client.
+  void PathChanged(const char *path)
+  {
+    cache_.Invalidate(path);
+    blockCache_.Invalidate(path);
+  }
+
+  static tSize pread_fetch(void *ctx, tOffset offset, char *buffer, tSize length)
+  {
+    hdfs_pread_ctx_t *pread = static_cast<hdfs_pread_ctx_t*>(ctx);
+    return hdfsPread(pread->fs, pread->file, offset, buffer, length);
+  }
+
+  // hdfsPread, through the block cache when the file was opened with it
+  tSize CachedPread(hdfsFS fs, hdfsFile_internal *file, const char *cachePath, tOffset offset,
+                    char *buffer, tSize length, int *cacheHits, int *cacheMisses)
+  {
+    if(!cachePath || !blockCache_.enabled()) return hdfsPread(fs, file, offset, buffer, length);
+    hdfs_pread_ctx_t ctx = { fs, file };
+    return blockCache_.Read(cachePath, offset, buffer, length, pread_fetch, &ctx, cacheHits, cacheMisses);
+  }
+
+  // configureReadCache({size, pageSize}) - size in bytes, 0 (the default)
+  // disables it; pageSize defaults to 64 KB
+  static Handle<Value> ConfigureReadCache(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    double size = 0;
+    int pageSize = 0;
+    if(args[0]->IsObject()) {
+      Local<Object> options = args[0]->ToObject();
+      Local<Value> value;
+      if((value = options->Get(String::NewSymbol("size")))->IsNumber()) size = value->NumberValue();
+      if((value = options->Get(String::NewSymbol("pageSize")))->IsNumber()) pageSize = value->Int32Value();
+    }
+    client->blockCache_.Configure(size, pageSize);
+
+    return Undefined();
+  }
+
+  static Handle<Value> ReadCacheStats(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    HdfsBlockCache::cache_stats_t stats = client->blockCache_.Stats();
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("hits"),      Number::New(stats.hits));
+    result->Set(String::NewSymbol("misses"),    Number::New(stats.misses));
+    result->Set(String::NewSymbol("coalesced"), Number::New(stats.coalesced));
+    result->Set(String::NewSymbol("evictions"), Number::New(stats.evictions));
+    result->Set(String::NewSymbol("bytes"),     Number::New(stats.bytes));
+    result->Set(String::NewSymbol("pages"),     Integer::New(stats.pages));
+    result->Set(String::NewSymbol("pageSize"),  Integer::New(stats.pageSize));
+    result->Set(String::NewSymbol("size"),      Number::New(stats.budget));
+    return scope.Close(result);
+  }
+
+  /*** metadata cache ***/
+
+  // The lookups below go through cache_ when it is enabled (worker thread).
+  // Results are released with hdfsFreeFileInfo either way.
+
+  hdfsFileInfo *GetPathInfo(hdfsFS fs, const char *path)
+  {
+    hdfsFileInfo *info;
+    unsigned long generation = cache_.Generation();
+    if(cache_.GetStat(path, &info)) return info;
+    info = hdfsGetPathInfo(fs, path);
+    if(info || MissingPath(fs)) cache_.PutStat(path, info, generation);
+    return info;
+  }
+
+  // whether a failed lookup means the path is missing rather than the
+  // NameNode being unreachable, which must not be cached as "does not
+  // exist"; errno is kept for pool_.Failed
+  bool MissingPath(hdfsFS fs)
+  {
+    int error = errno;
+    if(error == ENOENT) return true;
+    if(!cache_.enabled()) return false;
+    bool missing = hdfsExists(fs, "/") == 0;
+    errno = error;
+    return missing;
+  }
+
+  hdfsFileInfo *ListDirectory(hdfsFS fs, const char *path, int *numEntries)
+  {
+    hdfsFileInfo *list;
+    unsigned long generation = cache_.Generation();
+    if(cache_.GetList(path, &list, numEntries)) return list;
+    list = hdfsListDirectory(fs, path, numEntries);
+    // libhdfs returns NULL for both missing and empty directories
+    if(list) cache_.PutList(path, list, *numEntries, generation);
+    return list;
+  }
+
+  // same result as hdfsExists; with the cache enabled a stat is done instead
+  // so the answer can be cached either way
+  int PathExists(hdfsFS fs, const char *path)
+  {
+    if(!cache_.enabled()) return hdfsExists(fs, path);
+    hdfsFileInfo *info = GetPathInfo(fs, path);
+    if(!info) return -1;
+    hdfsFreeFileInfo(info, 1);
+    return 0;
+  }
+
+  // configureCache({ttl, maxEntries}) - a ttl of 0 (the default) disables it
+  static Handle<Value> ConfigureCache(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    double ttl = 0;
+    int maxEntries = 0;
+    if(args[0]->IsObject()) {
+      Local<Object> options = args[0]->ToObject();
+      Local<Value> value;
+      if((value = options->Get(String::NewSymbol("ttl")))->IsNumber()) ttl = value->NumberValue();
+      if((value = options->Get(String::NewSymbol("maxEntries")))->IsNumber()) maxEntries = value->Int32Value();
+    }
+    client->cache_.Configure(ttl, maxEntries);
+
+    return Undefined();
+  }
+
+  static Handle<Value> CacheStats(const Arguments &args)
+  {
+    HandleScope scope;
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+    HdfsMetadataCache::cache_stats_t stats = client->cache_.Stats();
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("hits"),          Number::New(stats.hits));
+    result->Set(String::NewSymbol("misses"),        Number::New(stats.misses));
+    result->Set(String::NewSymbol("evictions"),     Number::New(stats.evictions));
+    result->Set(String::NewSymbol("invalidations"), Number::New(stats.invalidations));
+    result->Set(String::NewSymbol("entries"),       Integer::New(stats.entries));
+    return scope.Close(result);
+  }
+
+  /*** batch ***/
+
+  enum hdfs_batch_op_t { BATCH_EXISTS, BATCH_STAT, BATCH_MKDIR, BATCH_RM, BATCH_RM_EMPTY, BATCH_RENAME };
+
+  // per-path result codes for everything but stat
+  enum { BATCH_OK = 0, BATCH_FAILED = -1, BATCH_NOT_FOUND = 1, BATCH_NOT_EMPTY = 2, BATCH_TARGET_EXISTS = 3 };
+
+  // paths handed to one worker at a time
+  static const int BATCH_CHUNK = 64;
+
+  struct hdfs_batch_baton_t {
+    HdfsClient *client;
+    Persistent<Function> cb;
+    hdfs_batch_op_t op;
+    int parallel;
+    int next;
+    int inflight;
+    std::vector<char *> paths;
+    std::vector<char *> targets;   // rename destinations
+    std::vector<int> results;
+    std::vector<hdfsFileInfo *> infos;
+  };
+
+  struct hdfs_batch_req_t {
+    hdfs_batch_baton_t *batch;
+    hdfs_conn_t *conn;
+    int start;
+    int end;
+  };
+
+  // batch(op, paths, [options], cb) - op: "exists", "stat", "mkdir", "rm"
+  // (recursive), "rmEmpty" (fails on non-empty directories) or "rename",
+  // for which paths are [src, dst] pairs; options: { parallel }
+  // Callback receives (err, results) with one entry per path, in order: an
+  // info object or null for stat, a result code for the rest.
+  static Handle<Value> Batch(const Arguments &args)
+  {
+    HandleScope scope;
+
+    int cbIndex = args[2]->IsFunction() ? 2 : 3;
+    REQ_FUN_ARG(cbIndex, cb);
+
+    if(!args[1]->IsArray()) {
+      return ThrowException(Exception::TypeError(String::New("Argument 1 must be an array of paths")));
+    }
+
+    v8::String::Utf8Value opStr(args[0]);
+    hdfs_batch_op_t op;
+    if(!strcmp(*opStr, "exists"))       op = BATCH_EXISTS;
+    else if(!strcmp(*opStr, "stat"))    op = BATCH_STAT;
+    else if(!strcmp(*opStr, "mkdir"))   op = BATCH_MKDIR;
+    else if(!strcmp(*opStr, "rm"))      op = BATCH_RM;
+    else if(!strcmp(*opStr, "rmEmpty")) op = BATCH_RM_EMPTY;
+    else if(!strcmp(*opStr, "rename"))  op = BATCH_RENAME;
+    else return ThrowException(Exception::TypeError(String::New("Unknown batch operation")));
+
+    HdfsClient* client = ObjectWrap::Unwrap<HdfsClient>(args.This());
+
+    hdfs_batch_baton_t *baton = new hdfs_batch_baton_t();
+    baton->client = client;
+    baton->cb = Persistent<Function>::New(cb);
+    baton->op = op;
+    baton->parallel = 8;
+    baton->next = 0;
+    baton->inflight = 0;
+
+    if(cbIndex == 3 && args[2]->IsObject()) {
+      Local<Value> value = args[2]->ToObject()->Get(String::NewSymbol("parallel"));
+      if(value->IsNumber()) baton->parallel = value->Int32Value();
+    }
+    if(baton->parallel < 1) baton->parallel = 1;
+
+    Local<Array> paths = Local<Array>::Cast(args[1]);
+    int count = paths->Length();
+    baton->paths.resize(count);
+    baton->results.resize(count, BATCH_FAILED);
+    baton->infos.resize(count, (hdfsFileInfo *) NULL);
+    if(op == BATCH_RENAME) baton->targets.resize(count);
+    for(int i=0; i<count; i++) {
+      Local<Value> path = paths->Get(i);
+      if(op == BATCH_RENAME) {
+        Local<Array> pair = path->IsArray() ? Local<Array>::Cast(path) : Array::New(0);
+        v8::String::Utf8Value srcStr(pair->Get(0));
+        v8::String::Utf8Value dstStr(pair->Get(1));
+        baton->paths[i] = strdup(*srcStr);
+        baton->targets[i] = strdup(*dstStr);
+      } else {
+        v8::String::Utf8Value pathStr(path);
+        baton->paths[i] = strdup(*pathStr);
+      }
+    }
+
+    client->Ref();
+    BatchPump(baton);
+
+    return Undefined();
+  }
+
+  static void BatchPump(hdfs_batch_baton_t *batch)
+  {
+    int count = batch->paths.size();
+    // an empty batch still goes through the pool once so the callback is never synchronous
+    bool empty = count == 0 && batch->inflight == 0;
+    while(batch->inflight < batch->parallel && (batch->next < count || empty)) {
+      empty = false;
+      hdfs_batch_req_t *req = new hdfs_batch_req_t();
+      req->batch = batch;
+      req->conn = batch->client->pool_.Acquire();
+      req->start = batch->next;
+      req->end = std::min(count, batch->next + BATCH_CHUNK);
+      batch->next = req->end;
+      batch->inflight++;
+
+      HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "batch", work_hdfs_batch, after_hdfs_batch, req);
+      ev_ref(EV_DEFAULT_UC);
+    }
+  }
+
+  // a single round-trip on success; the failure paths pay for the extra
+  // lookups needed to tell "missing" from "refused"
+  static int BatchDelete(hdfsFS fs, const char *path, bool emptyOnly)
+  {
+    if(emptyOnly) {
+      hdfsFileInfo *info = hdfsGetPathInfo(fs, path);
+      if(!info) return BATCH_NOT_FOUND;
+      bool isDirectory = info->mKind == kObjectKindDirectory;
+      hdfsFreeFileInfo(info, 1);
+
+      if(isDirectory) {
+        int numEntries = 0;
+        hdfsFileInfo *list = hdfsListDirectory(fs, path, &numEntries);
+        if(list) hdfsFreeFileInfo(list, numEntries);
+        if(numEntries > 0) return BATCH_NOT_EMPTY;
+      }
+    }
+
+    if(hdfsDelete(fs, path) == 0) return BATCH_OK;
+    return hdfsExists(fs, path) == 0 ? BATCH_FAILED : BATCH_NOT_FOUND;
+  }
+
+  // HDFS renames refuse to overwrite; the lookups only happen on failure
+  static int BatchRename(hdfsFS fs, const char *src, const char *dst)
+  {
+    if(hdfsRename(fs, src, dst) == 0) return BATCH_OK;
+    if(hdfsExists(fs, src) != 0) return BATCH_NOT_FOUND;
+    return hdfsExists(fs, dst) == 0 ? BATCH_TARGET_EXISTS : BATCH_FAILED;
+  }
+
+  static int work_hdfs_batch(hdfs_work_t *req)
+  {
+    hdfs_batch_req_t *batchReq = static_cast<hdfs_batch_req_t*>(req->data);
+    hdfs_batch_baton_t *batch = batchReq->batch;
+
+    hdfsFS fs = batch->client->pool_.Get(batchReq->conn);
+    req->failed = !fs;
+    if(!fs) return 0;
+
+    for(int i=batchReq->start; i<batchReq->end; i++) {
+      const char *path = batch->paths[i];
+      switch(batch->op) {
+        case BATCH_EXISTS:
+          batch->results[i] = batch->client->PathExists(fs, path) == 0 ? BATCH_OK : BATCH_NOT_FOUND;
+          break;
+        case BATCH_STAT:
+          batch->infos[i] = batch->client->GetPathInfo(fs, path);
+          batch->results[i] = batch->infos[i] ? BATCH_OK : BATCH_NOT_FOUND;
+          break;
+        case BATCH_MKDIR:
+          batch->results[i] = hdfsCreateDirectory(fs, path) == 0 ? BATCH_OK : BATCH_FAILED;
+          batch->client->PathChanged(path);
+          break;
+        case BATCH_RM:
+          batch->results[i] = BatchDelete(fs, path, false);
+          batch->client->PathChanged(path);
+          break;
+        case BATCH_RM_EMPTY:
+          batch->results[i] = BatchDelete(fs, path, true);
+          batch->client->PathChanged(path);
+          break;
+        case BATCH_RENAME:
+          batch->results[i] = BatchRename(fs, path, batch->targets[i]);
+          batch->client->PathChanged(path);
+          batch->client->PathChanged(batch->targets[i]);
+          break;
+      }
+      // a dropped connection fails the rest of the chunk; the next one reconnects
+      if(batch->results[i] != BATCH_OK && batch->client->pool_.Failed(batchReq->conn, fs)) break;
+    }
+    return 0;
+  }
+
+  static int after_hdfs_batch(hdfs_work_t *req)
+  {
+    HandleScope scope;
+    hdfs_batch_req_t *batchReq = static_cast<hdfs_batch_req_t*>(req->data);
+    hdfs_batch_baton_t *batch = batchReq->batch;
+
+    ev_unref(EV_DEFAULT_UC);
+    batch->client->pool_.Release(batchReq->conn);
+    batch->inflight--;
+    delete batchReq;
+
+    if(batch->inflight == 0 && batch->next == (int)batch->paths.size()) {
+      BatchCallback(batch);
+    } else {
+      BatchPump(batch);
+    }
     return 0;
   }
 
+  static void BatchCallback(hdfs_batch_baton_t *batch)
+  {
+    int count = batch->paths.size();
+    Local<Array> results = Array::New(count);
+    for(int i=0; i<count; i++) {
+      if(batch->op != BATCH_STAT) {
+        results->Set(i, Integer::New(batch->results[i]));
+      } else if(batch->infos[i]) {
+        results->Set(i, batch->client->fileInfoToObject(batch->infos[i]));
+      } else {
+        results->Set(i, Null());
+      }
+    }
+
+    Handle<Value> argv[2];
+    argv[0] = Undefined();
+    argv[1] = results;
+
+    TryCatch try_catch;
+
+    batch->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+    if (try_catch.HasCaught()) {
+      FatalException(try_catch);
+    }
+
+    for(int i=0; i<count; i++) {
+      free(batch->paths[i]);
+      if(batch->op == BATCH_RENAME) free(batch->targets[i]);
+      if(batch->infos[i]) hdfsFreeFileInfo(batch->infos[i], 1);
+    }
+    batch->client->Unref();
+    batch->cb.Dispose();
+    delete batch;
+  }
+
 
 };
 
 Persistent<FunctionTemplate> HdfsClient::s_ct;
+Persistent<Function> HdfsClient::s_slowOp;
 
 extern "C" {
   static void init (Handle<Object> target)
@@ -0,0 +1,227 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hdfs_block_cache.h"
+
+// "hdfs://host:port/a/b/" -> "/a/b"
+static std::string block_cache_key(const char *path)
+{
+  const char *scheme = strstr(path, "://");
+  if(scheme) {
+    path = strchr(scheme + 3, '/');
+    if(!path) path = "/";
+  }
+  std::string key(path);
+  while(key.size() > 1 && key[key.size() - 1] == '/') key.erase(key.size() - 1);
+  return key;
+}
+
+HdfsBlockCache::HdfsBlockCache()
+{
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&loaded_, NULL);
+  budget_ = 0;
+  pageSize_ = DEFAULT_PAGE_SIZE;
+  bytes_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+HdfsBlockCache::~HdfsBlockCache()
+{
+  Clear();
+  pthread_cond_destroy(&loaded_);
+  pthread_mutex_destroy(&lock_);
+}
+
+void HdfsBlockCache::Configure(double budget, int pageSize)
+{
+  if(pageSize <= 0) pageSize = DEFAULT_PAGE_SIZE;
+
+  pthread_mutex_lock(&lock_);
+  bool resized = pageSize != pageSize_;
+  budget_ = budget > 0 ? budget : 0;
+  pageSize_ = pageSize;
+  pthread_mutex_unlock(&lock_);
+
+  // page indexes are only meaningful for the page size they were cut with
+  if(budget <= 0 || resized) {
+    Clear();
+  } else {
+    pthread_mutex_lock(&lock_);
+    EvictOverflow();
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+bool HdfsBlockCache::enabled()
+{
+  pthread_mutex_lock(&lock_);
+  bool enabled = budget_ > 0;
+  pthread_mutex_unlock(&lock_);
+  return enabled;
+}
+
+tSize HdfsBlockCache::Read(const char *path, tOffset offset, char *buffer, tSize length,
+                           fetch_fn fetch, void *ctx, int *pageHits, int *pageMisses)
+{
+  std::string key = block_cache_key(path);
+  tSize total = 0;
+
+  pthread_mutex_lock(&lock_);
+  int pageSize = pageSize_;
+
+  while(total < length) {
+    tOffset pos = offset + total;
+    page_key_t pageKey(key, pos / pageSize);
+    page_map_t::iterator it = pages_.find(pageKey);
+
+    if(it != pages_.end() && it->second->loading) {
+      stats_.coalesced++;
+      pthread_cond_wait(&loaded_, &lock_);
+      continue;   // the page may have been dropped meanwhile, look it up again
+    }
+
+    page_t *page;
+    char *data;
+    bool keep = true;
+
+    if(it != pages_.end()) {
+      page = it->second;
+      data = page->data;
+      lru_.splice(lru_.begin(), lru_, page->lru);
+      stats_.hits++;
+      (*pageHits)++;
+    } else {
+      page = new page_t();
+      page->key = pageKey;
+      page->data = NULL;
+      page->length = 0;
+      page->loading = true;
+      page->stale = false;
+      pages_[pageKey] = page;
+      stats_.misses++;
+      (*pageMisses)++;
+
+      pthread_mutex_unlock(&lock_);
+      data = (char *) malloc(pageSize);
+      tSize loaded = Load(fetch, ctx, pageKey.second * pageSize, data, pageSize);
+      pthread_mutex_lock(&lock_);
+
+      page->loading = false;
+      keep = loaded >= 0 && !page->stale && budget_ > 0 && pageSize == pageSize_;
+      if(keep) {
+        page->data = data;
+        page->length = loaded;
+        bytes_ += loaded;
+        lru_.push_front(page);
+        page->lru = lru_.begin();
+      } else {
+        pages_.erase(pageKey);
+      }
+      pthread_cond_broadcast(&loaded_);
+
+      if(loaded < 0) {
+        free(data);
+        delete page;
+        pthread_mutex_unlock(&lock_);
+        return total > 0 ? total : -1;
+      }
+      page->length = loaded;
+    }
+
+    tSize within = pos - pageKey.second * pageSize;
+    tSize n = page->length - within;
+    if(n > length - total) n = length - total;
+    if(n > 0) {
+      memcpy(buffer + total, data + within, n);
+      total += n;
+    }
+    bool eof = n <= 0 || page->length < pageSize;
+
+    if(!keep) {
+      free(data);
+      delete page;
+    } else {
+      EvictOverflow();
+    }
+    if(eof && total < length) break;
+  }
+
+  pthread_mutex_unlock(&lock_);
+  return total;
+}
+
+tSize HdfsBlockCache::Load(fetch_fn fetch, void *ctx, tOffset offset, char *buffer, tSize length)
+{
+  tSize total = 0;
+  while(total < length) {
+    tSize n = fetch(ctx, offset + total, buffer + total, length - total);
+    if(n < 0) return total > 0 ? total : -1;
+    if(n == 0) break;
+    total += n;
+  }
+  return total;
+}
+
+void HdfsBlockCache::Invalidate(const char *path)
+{
+  std::string key = block_cache_key(path);
+  std::string prefix = key == "/" ? key : key + "/";
+
+  pthread_mutex_lock(&lock_);
+  if(!pages_.empty()) {
+    page_map_t::iterator it = pages_.lower_bound(page_key_t(key, 0));
+    while(it != pages_.end() && it->first.first == key) Drop(it++);
+
+    it = pages_.lower_bound(page_key_t(prefix, 0));
+    while(it != pages_.end() && it->first.first.compare(0, prefix.size(), prefix) == 0) Drop(it++);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void HdfsBlockCache::Clear()
+{
+  pthread_mutex_lock(&lock_);
+  page_map_t::iterator it = pages_.begin();
+  while(it != pages_.end()) Drop(it++);
+  pthread_mutex_unlock(&lock_);
+}
+
+HdfsBlockCache::cache_stats_t HdfsBlockCache::Stats()
+{
+  pthread_mutex_lock(&lock_);
+  cache_stats_t stats = stats_;
+  stats.bytes = bytes_;
+  stats.pages = lru_.size();
+  stats.pageSize = pageSize_;
+  stats.budget = budget_;
+  pthread_mutex_unlock(&lock_);
+  return stats;
+}
+
+// pages still loading belong to their reader, which drops them when done
+void HdfsBlockCache::Drop(page_map_t::iterator it)
+{
+  page_t *page = it->second;
+  if(page->loading) {
+    page->stale = true;
+    return;
+  }
+  bytes_ -= page->length;
+  lru_.erase(page->lru);
+  pages_.erase(it);
+  free(page->data);
+  delete page;
+}
+
+void HdfsBlockCache::EvictOverflow()
+{
+  while(bytes_ > budget_ && !lru_.empty()) {
+    Drop(pages_.find(lru_.back()->key));
+    stats_.evictions++;
+  }
+}
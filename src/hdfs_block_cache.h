@@ -0,0 +1,90 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_BLOCK_CACHE_H
+#define HDFS_BLOCK_CACHE_H
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <string>
+#include "../vendor/hdfs.h"
+
+// Read cache of fixed-size, aligned pages of file contents, keyed by path
+// (without scheme and authority) and page index. Pages are evicted least
+// recently used first once their total size goes over the memory budget.
+// A page that is being loaded is marked as such and later readers of it
+// wait for that load instead of issuing their own pread. The last page of a
+// file is kept short, which is how end of file is found again on a hit.
+// Writes made through the owning client invalidate the path; changes made
+// by other clients are not detected. Used from the worker threads, under lock.
+class HdfsBlockCache
+{
+public:
+  struct cache_stats_t {
+    double hits;        // pages served from memory
+    double misses;      // pages loaded
+    double coalesced;   // reads that waited for another read's load
+    double evictions;
+    double bytes;
+    int pages;
+    int pageSize;
+    double budget;
+  };
+
+  // Fills up to length bytes at offset; returns the bytes read, 0 at end of
+  // file and -1 on error, like hdfsPread.
+  typedef tSize (*fetch_fn)(void *ctx, tOffset offset, char *buffer, tSize length);
+
+  static const int DEFAULT_PAGE_SIZE = 64 * 1024;
+
+  HdfsBlockCache();
+  ~HdfsBlockCache();
+
+  // budget (bytes) <= 0 disables the cache and drops everything in it
+  void Configure(double budget, int pageSize);
+  bool enabled();
+
+  // Reads [offset, offset + length) of path into buffer, loading missing
+  // pages through fetch. Returns the bytes read (short at end of file) or
+  // -1 when nothing could be read; pageHits/pageMisses are incremented per page.
+  tSize Read(const char *path, tOffset offset, char *buffer, tSize length,
+             fetch_fn fetch, void *ctx, int *pageHits, int *pageMisses);
+
+  // drops the pages of path and of everything below it
+  void Invalidate(const char *path);
+  void Clear();
+
+  cache_stats_t Stats();
+
+private:
+  typedef std::pair<std::string, tOffset> page_key_t;
+
+  struct page_t {
+    page_key_t key;
+    char *data;
+    tSize length;
+    bool loading;
+    bool stale;   // invalidated while loading: dropped once loaded
+    std::list<page_t *>::iterator lru;
+  };
+
+  typedef std::map<page_key_t, page_t *> page_map_t;
+
+  tSize Load(fetch_fn fetch, void *ctx, tOffset offset, char *buffer, tSize length);
+  void Drop(page_map_t::iterator it);
+  void EvictOverflow();
+
+  pthread_mutex_t lock_;
+  pthread_cond_t loaded_;
+  double budget_;
+  int pageSize_;
+  double bytes_;
+  page_map_t pages_;
+  std::list<page_t *> lru_;   // loaded pages, most recently used first
+  cache_stats_t stats_;
+};
+
+#endif
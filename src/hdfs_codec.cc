@@ -0,0 +1,139 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hdfs_codec.h"
+
+int HdfsCodec::Parse(const char *name)
+{
+  if(!strcmp(name, "none")) return NONE;
+  if(!strcmp(name, "gzip")) return GZIP;
+  return -1;
+}
+
+HdfsCodec::HdfsCodec(int type, bool compress, int level)
+{
+  pthread_mutex_init(&lock_, NULL);
+  compress_ = compress;
+  ended_ = false;
+  failed_ = false;
+  corrupt_ = false;
+  inMember_ = false;
+  inputOffset_ = 0;
+  outputOffset_ = 0;
+  compressedBytes_ = 0;
+  buffer_ = (char *) malloc(IO_BUFFER_SIZE);
+
+  memset(&stream_, 0, sizeof(stream_));
+  if(compress_) {
+    if(level < 0 || level > 9) level = Z_DEFAULT_COMPRESSION;
+    // 16 + MAX_WBITS writes a gzip header and trailer
+    ready_ = deflateInit2(&stream_, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  } else {
+    // 32 + MAX_WBITS detects gzip or zlib headers
+    ready_ = inflateInit2(&stream_, 32 + MAX_WBITS) == Z_OK;
+  }
+}
+
+HdfsCodec::~HdfsCodec()
+{
+  if(ready_) compress_ ? deflateEnd(&stream_) : inflateEnd(&stream_);
+  free(buffer_);
+  pthread_mutex_destroy(&lock_);
+}
+
+tSize HdfsCodec::Read(hdfsFS fs, hdfsFile file, tOffset offset, char *buffer, tSize length)
+{
+  pthread_mutex_lock(&lock_);
+  if(!ready_ || compress_ || failed_ || offset != outputOffset_) {
+    tSize ret = corrupt_ ? CORRUPT : -1;
+    pthread_mutex_unlock(&lock_);
+    return ret;
+  }
+
+  stream_.next_out = (Bytef *) buffer;
+  stream_.avail_out = length;
+
+  while(stream_.avail_out > 0 && !ended_) {
+    if(stream_.avail_in == 0) {
+      tSize n = hdfsPread(fs, file, inputOffset_, buffer_, IO_BUFFER_SIZE);
+      if(n < 0) {
+        failed_ = true;
+        break;
+      }
+      if(n == 0) {
+        ended_ = true;
+        corrupt_ = failed_ = inMember_;
+        break;
+      }
+      inputOffset_ += n;
+      compressedBytes_ += n;
+      stream_.next_in = (Bytef *) buffer_;
+      stream_.avail_in = n;
+    }
+
+    int ret = inflate(&stream_, Z_NO_FLUSH);
+    if(ret == Z_STREAM_END) {
+      // another gzip member may follow; the end of the file ends it all
+      inflateReset(&stream_);
+      inMember_ = false;
+    } else if(ret == Z_OK || ret == Z_BUF_ERROR) {
+      inMember_ = true;
+    } else {
+      corrupt_ = failed_ = true;
+      break;
+    }
+  }
+
+  tSize produced = length - stream_.avail_out;
+  outputOffset_ += produced;
+  tSize ret = corrupt_ ? CORRUPT : failed_ ? -1 : produced;
+  pthread_mutex_unlock(&lock_);
+
+  return ret;
+}
+
+tSize HdfsCodec::Write(hdfsFS fs, hdfsFile file, const char *data, tSize length)
+{
+  pthread_mutex_lock(&lock_);
+  stream_.next_in = (Bytef *) data;
+  stream_.avail_in = length;
+  int ret = ready_ && compress_ && !failed_ ? Deflate(fs, file, Z_NO_FLUSH) : -1;
+  pthread_mutex_unlock(&lock_);
+  return ret == 0 ? length : -1;
+}
+
+int HdfsCodec::Flush(hdfsFS fs, hdfsFile file, bool finish)
+{
+  pthread_mutex_lock(&lock_);
+  int ret = 0;
+  if(ready_ && compress_ && !ended_) {
+    ret = failed_ ? -1 : Deflate(fs, file, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    if(finish) ended_ = true;
+  }
+  pthread_mutex_unlock(&lock_);
+  return ret;
+}
+
+// deflates whatever input is pending and writes the output; with lock_ held
+int HdfsCodec::Deflate(hdfsFS fs, hdfsFile file, int mode)
+{
+  do {
+    stream_.next_out = (Bytef *) buffer_;
+    stream_.avail_out = IO_BUFFER_SIZE;
+    if(deflate(&stream_, mode) == Z_STREAM_ERROR) {
+      failed_ = true;
+      return -1;
+    }
+    tSize have = IO_BUFFER_SIZE - stream_.avail_out;
+    if(have > 0 && hdfsWrite(fs, file, buffer_, have) != have) {
+      failed_ = true;
+      return -1;
+    }
+    compressedBytes_ += have;
+  } while(stream_.avail_out == 0);
+  return 0;
+}
@@ -0,0 +1,64 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_CODEC_H
+#define HDFS_CODEC_H
+
+#include <pthread.h>
+#include <zlib.h>
+#include "../vendor/hdfs.h"
+
+// Streaming compression applied on the worker threads, between the JS
+// buffers and hdfsPread/hdfsWrite. A file opened for reading is inflated
+// (gzip or zlib, concatenated gzip members included) and can only be read
+// sequentially: each read must start where the previous one ended, in
+// uncompressed bytes. A file opened for writing is deflated to gzip;
+// Flush(false) pushes out everything written so far as a sync point and
+// Flush(true) ends the stream, before the file is closed. Calls on the same
+// file are serialized.
+class HdfsCodec
+{
+public:
+  enum { NONE = 0, GZIP = 1 };
+
+  static const int IO_BUFFER_SIZE = 256 * 1024;
+  static const tSize CORRUPT = -2;
+
+  // codec name ("gzip") to type; NONE for "none", -1 if unknown
+  static int Parse(const char *name);
+
+  HdfsCodec(int type, bool compress, int level);
+  ~HdfsCodec();
+
+  // hdfsPread-like: returns the uncompressed bytes read, 0 at the end of
+  // the stream and -1 on error or when offset is not where the last read
+  // ended. Data that does not inflate, or a file that ends inside a gzip
+  // member, is CORRUPT, for this read and all the following ones.
+  tSize Read(hdfsFS fs, hdfsFile file, tOffset offset, char *buffer, tSize length);
+
+  // returns length, or -1 if the compressed data could not be written
+  tSize Write(hdfsFS fs, hdfsFile file, const char *data, tSize length);
+  int Flush(hdfsFS fs, hdfsFile file, bool finish);
+
+  double compressedBytes() const { return compressedBytes_; }
+
+private:
+  int Deflate(hdfsFS fs, hdfsFile file, int mode);
+
+  pthread_mutex_t lock_;
+  bool compress_;
+  bool ready_;
+  bool ended_;
+  bool failed_;
+  bool corrupt_;
+  bool inMember_;           // inflating a member that has not ended yet
+  z_stream stream_;
+  char *buffer_;            // compressed input (read) or output (write)
+  tOffset inputOffset_;     // next compressed offset to read
+  tOffset outputOffset_;    // uncompressed offset of the next read
+  double compressedBytes_;  // read or written
+};
+
+#endif
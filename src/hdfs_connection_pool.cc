@@ -0,0 +1,371 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "hdfs_connection_pool.h"
+#include "hdfs_worker_pool.h"
+
+static double pool_now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// duration of the first connect in the process, which starts the JVM
+static double s_jvmStartMs = -1;
+static pthread_mutex_t s_jvmStartLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void noteFirstConnect(double ms)
+{
+  pthread_mutex_lock(&s_jvmStartLock);
+  if(s_jvmStartMs < 0) s_jvmStartMs = ms;
+  pthread_mutex_unlock(&s_jvmStartLock);
+}
+
+// state and failures are written by the workers and read on the main thread
+static int conn_read(volatile int *value)
+{
+  return __sync_fetch_and_add(value, 0);
+}
+
+static void conn_set_state(hdfs_conn_t *conn, int state)
+{
+  __sync_synchronize();
+  conn->state = state;
+  __sync_synchronize();
+}
+
+static int work_disconnect(hdfs_work_t *req)
+{
+  hdfsDisconnect((hdfsFS) req->data);
+  return 0;
+}
+
+static int after_disconnect(hdfs_work_t *req)
+{
+  return 0;
+}
+
+// hdfsDisconnect closes the Java FileSystem, which may block on the
+// NameNode, so it runs on a metadata worker
+static void disconnect_later(hdfsFS fs)
+{
+  HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "disconnect", work_disconnect, after_disconnect, fs);
+}
+
+// disconnects every handle of a set nothing uses any more, then frees it
+static int work_close_set(hdfs_work_t *req)
+{
+  hdfs_conn_set_t *set = static_cast<hdfs_conn_set_t*>(req->data);
+  for(int i=0; i<set->size; i++) {
+    hdfs_conn_t *conn = &set->conns[i];
+    if(conn->fs) hdfsDisconnect(conn->fs);
+    for(size_t j=0; j<conn->retired.size(); j++) hdfsDisconnect(conn->retired[j]);
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->ready);
+  }
+  delete [] set->conns;
+  free(set->host);
+  free(set->user);
+  delete set;
+  return 0;
+}
+
+// errno values that blame the path or the request, not the connection
+static bool path_errno(int err)
+{
+  switch(err) {
+    case 0: case ENOENT: case EEXIST: case EACCES: case EPERM: case ENOTDIR:
+    case EISDIR: case ENOTEMPTY: case EINVAL: case ENOTSUP: case EDQUOT:
+    case ENOSPC: case ENAMETOOLONG: case EROFS:
+      return true;
+    default:
+      return false;
+  }
+}
+
+HdfsConnectionPool::HdfsConnectionPool()
+{
+  set_ = NULL;
+  idleTimeout_ = 0;
+  pthread_mutex_init(&statsLock_, NULL);
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+// Operations hold a reference to the client, so none is in flight once it
+// is collected; files still open then are abandoned, and the sets they pin
+// are closed anyway.
+HdfsConnectionPool::~HdfsConnectionPool()
+{
+  Disconnect();
+  for(size_t i=0; i<closing_.size(); i++) Close(closing_[i]);
+  pthread_mutex_destroy(&statsLock_);
+}
+
+bool HdfsConnectionPool::Connect(const char *host, tPort port, const char *user, int size, int idleTimeout, bool block)
+{
+  Disconnect();
+
+  hdfs_conn_set_t *set = new hdfs_conn_set_t();
+  set->host = strdup(host);
+  set->port = port;
+  set->user = user ? strdup(user) : NULL;
+  set->size = size > 0 ? size : 1;
+  set->closed = false;
+  set->conns = new hdfs_conn_t[set->size];
+  idleTimeout_ = idleTimeout;
+  set_ = set;
+
+  for(int i=0; i<set->size; i++) {
+    hdfs_conn_t *conn = &set->conns[i];
+    conn->fs = NULL;
+    conn->state = CONN_CLOSED;
+    conn->failures = 0;
+    conn->busy = 0;
+    conn->files = 0;
+    conn->lastUsed = 0;
+    conn->failedAt = 0;
+    conn->seenFailures = 0;
+    conn->set = set;
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->ready, NULL);
+  }
+
+  if(!block) return true;
+  hdfs_conn_t *first = &set->conns[0];
+  first->fs = Open(set);
+  first->state = first->fs ? CONN_OPEN : CONN_FAILED;
+  if(!first->fs) first->failedAt = pool_now_ms();
+  return first->fs != NULL;
+}
+
+// Operations in flight and open files keep using their slots; the set is
+// closed by the Release() or FileClosed() that frees its last slot.
+void HdfsConnectionPool::Disconnect()
+{
+  if(!set_) return;
+  set_->closed = true;
+  if(Idle(set_)) {
+    Close(set_);
+  } else {
+    closing_.push_back(set_);
+  }
+  set_ = NULL;
+}
+
+bool HdfsConnectionPool::Idle(hdfs_conn_set_t *set)
+{
+  for(int i=0; i<set->size; i++) {
+    if(set->conns[i].busy > 0 || set->conns[i].files > 0) return false;
+  }
+  return true;
+}
+
+void HdfsConnectionPool::Close(hdfs_conn_set_t *set)
+{
+  HdfsWorkerPool::Instance().Submit(HdfsWorkerPool::METADATA, "disconnect", work_close_set, after_disconnect, set);
+}
+
+hdfsFS HdfsConnectionPool::Open(hdfs_conn_set_t *set)
+{
+  double start = pool_now_ms();
+  hdfsFS fs = set->user ? hdfsConnectAsUserNewInstance(set->host, set->port, set->user)
+                        : hdfsConnectNewInstance(set->host, set->port);
+  double ms = pool_now_ms() - start;
+  noteFirstConnect(ms);
+
+  pthread_mutex_lock(&statsLock_);
+  stats_.connects++;
+  if(!fs) stats_.failures++;
+  stats_.lastMs = ms;
+  if(ms > stats_.maxMs) stats_.maxMs = ms;
+  stats_.totalMs += ms;
+  pthread_mutex_unlock(&statsLock_);
+
+  return fs;
+}
+
+HdfsConnectionPool::connect_stats_t HdfsConnectionPool::ConnectStats()
+{
+  pthread_mutex_lock(&statsLock_);
+  connect_stats_t stats = stats_;
+  pthread_mutex_unlock(&statsLock_);
+  return stats;
+}
+
+bool HdfsConnectionPool::WarmUp()
+{
+  double start = pool_now_ms();
+  hdfsFS fs = hdfsConnectNewInstance(NULL, 0);
+  noteFirstConnect(pool_now_ms() - start);
+  if(fs) hdfsDisconnect(fs);
+  return fs != NULL;
+}
+
+double HdfsConnectionPool::JvmStartMs()
+{
+  pthread_mutex_lock(&s_jvmStartLock);
+  double ms = s_jvmStartMs;
+  pthread_mutex_unlock(&s_jvmStartLock);
+  return ms;
+}
+
+int HdfsConnectionPool::connected()
+{
+  int count = 0;
+  for(int i=0; set_ && i<set_->size; i++) {
+    if(conn_read(&set_->conns[i].state) == CONN_OPEN) count++;
+  }
+  return count;
+}
+
+// Prefers an idle open connection, then a slot that can be (re)connected,
+// then the least busy open connection.
+hdfs_conn_t *HdfsConnectionPool::Acquire()
+{
+  if(!set_) return NULL;
+
+  double now = pool_now_ms();
+  hdfs_conn_t *leastBusy = NULL;
+  hdfs_conn_t *unopened = NULL;
+
+  for(int i=0; i<set_->size; i++) {
+    hdfs_conn_t *conn = &set_->conns[i];
+    int state = conn_read(&conn->state);
+    bool open = state == CONN_OPEN;
+    bool retry = (state == CONN_CLOSED || state == CONN_FAILED) && now - conn->failedAt >= RECONNECT_DELAY;
+
+    if(open) {
+      if(conn->busy == 0) { leastBusy = conn; break; }
+      if(!leastBusy || conn->busy < leastBusy->busy) leastBusy = conn;
+    } else if(retry && !unopened && conn->busy == 0) {
+      unopened = conn;
+    }
+  }
+
+  hdfs_conn_t *conn = (leastBusy && leastBusy->busy == 0) || !unopened ? leastBusy : unopened;
+  if(!conn) conn = &set_->conns[0];
+  conn->busy++;
+  return conn;
+}
+
+hdfs_conn_t *HdfsConnectionPool::AcquireFirst()
+{
+  if(!set_) return NULL;
+  set_->conns[0].busy++;
+  return &set_->conns[0];
+}
+
+void HdfsConnectionPool::Release(hdfs_conn_t *conn)
+{
+  if(!conn) return;
+  conn->busy--;
+  conn->lastUsed = pool_now_ms();
+
+  // a connect that failed on a worker since the last look
+  int failures = conn_read(&conn->failures);
+  if(failures != conn->seenFailures) {
+    conn->seenFailures = failures;
+    conn->failedAt = conn->lastUsed;
+  }
+  Settle(conn);
+}
+
+void HdfsConnectionPool::FileOpened(hdfs_conn_t *conn)
+{
+  conn->files++;
+}
+
+void HdfsConnectionPool::FileClosed(hdfs_conn_t *conn)
+{
+  conn->files--;
+  conn->lastUsed = pool_now_ms();
+  Settle(conn);
+}
+
+// Once nothing uses a slot, the handles dropped by Failed() are
+// disconnected, and so is its set if it was disconnected meanwhile.
+void HdfsConnectionPool::Settle(hdfs_conn_t *conn)
+{
+  if(conn->busy == 0 && conn->files == 0) {
+    for(size_t i=0; i<conn->retired.size(); i++) disconnect_later(conn->retired[i]);
+    conn->retired.clear();
+  }
+
+  hdfs_conn_set_t *set = conn->set;
+  if(!set->closed) return EvictIdle();
+  if(!Idle(set)) return;
+
+  closing_.erase(std::find(closing_.begin(), closing_.end(), set));
+  Close(set);
+}
+
+// The first connection is kept open for the life of the pool. With busy and
+// files at 0 no worker holds the slot, so its fs is taken without the lock.
+void HdfsConnectionPool::EvictIdle()
+{
+  if(!set_ || idleTimeout_ <= 0) return;
+  double now = pool_now_ms();
+
+  for(int i=1; i<set_->size; i++) {
+    hdfs_conn_t *conn = &set_->conns[i];
+    if(conn->busy > 0 || conn->files > 0 || !conn->fs || now - conn->lastUsed < idleTimeout_) continue;
+
+    hdfsFS fs = conn->fs;
+    conn->fs = NULL;
+    conn_set_state(conn, CONN_CLOSED);
+    disconnect_later(fs);
+  }
+}
+
+// Only one worker connects a slot at a time; the ones that find it
+// connecting wait and get the same result, failure included, rather than
+// each trying in turn. Open() runs without the lock.
+hdfsFS HdfsConnectionPool::Get(hdfs_conn_t *conn)
+{
+  if(!conn) return NULL;
+
+  pthread_mutex_lock(&conn->lock);
+  if(conn->state == CONN_CONNECTING) {
+    while(conn->state == CONN_CONNECTING) pthread_cond_wait(&conn->ready, &conn->lock);
+  } else if(!conn->fs) {
+    conn_set_state(conn, CONN_CONNECTING);
+    pthread_mutex_unlock(&conn->lock);
+
+    hdfsFS fs = Open(conn->set);
+
+    pthread_mutex_lock(&conn->lock);
+    conn->fs = fs;
+    if(!fs) __sync_fetch_and_add(&conn->failures, 1);
+    conn_set_state(conn, fs ? CONN_OPEN : CONN_FAILED);
+    pthread_cond_broadcast(&conn->ready);
+  }
+  hdfsFS fs = conn->fs;
+  pthread_mutex_unlock(&conn->lock);
+
+  errno = 0;
+  return fs;
+}
+
+// The handle is only retired here: files opened on it and operations that
+// already got it keep it until Settle() finds the slot unused.
+bool HdfsConnectionPool::Failed(hdfs_conn_t *conn, hdfsFS fs)
+{
+  if(!conn || !fs || path_errno(errno)) return false;
+  if(hdfsExists(fs, "/") == 0) return false;
+
+  pthread_mutex_lock(&conn->lock);
+  if(conn->fs == fs) {
+    conn->fs = NULL;
+    conn->retired.push_back(fs);
+    conn_set_state(conn, CONN_CLOSED);
+  }
+  pthread_mutex_unlock(&conn->lock);
+  return true;
+}
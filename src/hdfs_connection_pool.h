@@ -0,0 +1,122 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_CONNECTION_POOL_H
+#define HDFS_CONNECTION_POOL_H
+
+#include <pthread.h>
+#include <vector>
+#include "../vendor/hdfs.h"
+
+enum { CONN_CLOSED = 0, CONN_CONNECTING, CONN_OPEN, CONN_FAILED };
+
+struct hdfs_conn_set_t;
+
+// One hdfsFS handle of a pool. The first worker that needs a closed handle
+// marks it CONN_CONNECTING and connects without holding the lock; workers
+// that need it meanwhile wait on `ready` and share the outcome. state and
+// failures are read on the main thread without the lock. busy, files,
+// lastUsed, failedAt and seenFailures are only touched on the main thread,
+// which also takes fs (and the retired handles) back from a slot once
+// nothing is using it (busy == 0 and files == 0): no worker can be holding
+// them then.
+struct hdfs_conn_t {
+  hdfsFS fs;
+  std::vector<hdfsFS> retired; // dropped after failing, still used by files or operations
+  volatile int state;          // CONN_*, changed under lock
+  volatile int failures;       // failed connects, bumped under lock
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int busy;          // operations submitted on this connection
+  int files;         // open files, which pin the connection
+  double lastUsed;
+  double failedAt;   // when the main thread last saw a connect fail, 0 if never
+  int seenFailures;
+  hdfs_conn_set_t *set;
+};
+
+// The slots of one Connect(). A set that was disconnected while operations
+// or files still held some of its slots is closed once the last of them is
+// released.
+struct hdfs_conn_set_t {
+  hdfs_conn_t *conns;
+  int size;
+  char *host;
+  tPort port;
+  char *user;
+  bool closed;
+};
+
+// Up to `size` hdfsConnect*NewInstance handles to the same (host, port,
+// user). The first one is opened by Connect(), unless told not to block, in
+// which case it is opened like the others: lazily, on the worker thread of
+// the first operation that is handed it. Operations submitted meanwhile
+// wait for that connect on their worker thread; the main thread never
+// waits for one. Handles other than the first are closed again, on a
+// worker, once they have been idle for idleTimeout ms. A handle that failed
+// to connect is not handed out again for RECONNECT_DELAY ms, unless no
+// other is available, and one whose NameNode stopped answering is replaced
+// by a new connection (see Failed()).
+class HdfsConnectionPool
+{
+public:
+  static const int RECONNECT_DELAY = 1000;
+
+  struct connect_stats_t {
+    double connects;
+    double failures;
+    double lastMs;    // duration of the last attempt
+    double maxMs;
+    double totalMs;
+  };
+
+  HdfsConnectionPool();
+  ~HdfsConnectionPool();
+
+  // Connect() disconnects first. Handles still used by operations in flight
+  // or by open files are disconnected once those are done with them.
+  bool Connect(const char *host, tPort port, const char *user, int size, int idleTimeout, bool block = true);
+  void Disconnect();
+
+  // main thread
+  hdfs_conn_t *Acquire();
+  hdfs_conn_t *AcquireFirst();   // the connection Connect() would have opened
+  void Release(hdfs_conn_t *conn);
+  void FileOpened(hdfs_conn_t *conn);
+  void FileClosed(hdfs_conn_t *conn);
+
+  // worker thread; NULL if the connection could not be established.
+  // Clears errno for Failed().
+  hdfsFS Get(hdfs_conn_t *conn);
+  // Worker thread, after a call on the fs Get() returned failed. Unless errno
+  // blames the path, checks that the NameNode still answers on fs, and if
+  // not drops it so that the next Get() reconnects. True if fs is dead.
+  bool Failed(hdfs_conn_t *conn, hdfsFS fs);
+
+  int connected();
+  connect_stats_t ConnectStats();
+
+  // Starts the JVM by connecting to the local filesystem, so that the first
+  // real connect only pays for the NameNode RPC. Worker thread.
+  static bool WarmUp();
+  // How long the first connect of the process took, JVM start included;
+  // -1 until it has happened.
+  static double JvmStartMs();
+
+private:
+  hdfsFS Open(hdfs_conn_set_t *set);
+  void Settle(hdfs_conn_t *conn);
+  void EvictIdle();
+  static bool Idle(hdfs_conn_set_t *set);
+  static void Close(hdfs_conn_set_t *set);
+
+  hdfs_conn_set_t *set_;            // NULL while disconnected
+  std::vector<hdfs_conn_set_t*> closing_;   // disconnected, waiting for their slots to be released
+  int idleTimeout_;
+  pthread_mutex_t statsLock_;
+  connect_stats_t stats_;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <stddef.h>
+#include "hdfs_file_table.h"
+
+HdfsFileTable::HdfsFileTable()
+{
+  freeHead_ = -1;
+  open_ = 0;
+}
+
+int HdfsFileTable::Create(hdfs_file_t *file)
+{
+  int index;
+
+  if(freeHead_ >= 0) {
+    index = freeHead_;
+    freeHead_ = slots_[index].nextFree;
+  } else {
+    if((int)slots_.size() >= MAX_FILES) return -1;
+    slot_t slot;
+    slot.generation = 1;
+    slots_.push_back(slot);
+    index = slots_.size() - 1;
+  }
+
+  slots_[index].file = file;
+  slots_[index].nextFree = -1;
+  open_++;
+  return (slots_[index].generation << INDEX_BITS) | index;
+}
+
+hdfs_file_t *HdfsFileTable::Get(int fh)
+{
+  if(fh < 0) return NULL;
+  int index = fh & (MAX_FILES - 1);
+  int generation = fh >> INDEX_BITS;
+
+  if(index >= (int)slots_.size()) return NULL;
+  slot_t &slot = slots_[index];
+  return slot.generation == generation ? slot.file : NULL;
+}
+
+hdfs_file_t *HdfsFileTable::Remove(int fh)
+{
+  hdfs_file_t *file = Get(fh);
+  if(!file) return NULL;
+
+  int index = fh & (MAX_FILES - 1);
+  slot_t &slot = slots_[index];
+  slot.file = NULL;
+  // generations cycle through 1 .. 2^GENERATION_BITS - 1
+  slot.generation = slot.generation % ((1 << GENERATION_BITS) - 1) + 1;
+  slot.nextFree = freeHead_;
+  freeHead_ = index;
+  open_--;
+  return file;
+}
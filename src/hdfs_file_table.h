@@ -0,0 +1,46 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_FILE_TABLE_H
+#define HDFS_FILE_TABLE_H
+
+#include <vector>
+
+struct hdfs_file_t;
+
+// Maps the integer handles given to JS to open files. Free slots are kept
+// in a list, so Create/Get/Remove are O(1), and the table grows as needed.
+// A handle is the slot index plus the slot's generation, which is bumped on
+// every Remove: a stale handle (used after close, or closed twice) no
+// longer matches and is rejected instead of hitting whatever file reuses
+// the slot. Only used from the main thread.
+class HdfsFileTable
+{
+public:
+  static const int INDEX_BITS = 20;
+  static const int GENERATION_BITS = 10;
+  static const int MAX_FILES = 1 << INDEX_BITS;
+
+  HdfsFileTable();
+
+  int Create(hdfs_file_t *file);   // -1 once MAX_FILES are open
+  hdfs_file_t *Get(int fh);        // NULL for unknown or stale handles
+  hdfs_file_t *Remove(int fh);     // returns the file so the caller frees it
+
+  int size() const { return open_; }
+
+private:
+  struct slot_t {
+    hdfs_file_t *file;
+    int generation;
+    int nextFree;
+  };
+
+  std::vector<slot_t> slots_;
+  int freeHead_;
+  int open_;
+};
+
+#endif
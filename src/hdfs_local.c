@@ -0,0 +1,720 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+/* Stand-in for libhdfs that implements vendor/hdfs.h over the local
+ * filesystem, so the addon can be built, benchmarked and tested without a
+ * JVM or a cluster (node-waf configure --hdfs-local). HDFS paths map to
+ * files under $HDFS_LOCAL_ROOT (default /tmp/hdfs-local), whatever the
+ * host and port connected to. Cluster behaviour is approximated from the
+ * environment:
+ *
+ *   HDFS_LOCAL_CONNECT_MS     delay of every connect (JVM start, RPC setup)
+ *   HDFS_LOCAL_LATENCY_MS     delay of every NameNode operation: open,
+ *                             close, stat, list, mkdir, delete, ...
+ *   HDFS_LOCAL_DATA_MS        delay of every read, pread and write call
+ *   HDFS_LOCAL_BANDWIDTH_MB   MB/s shared by all reads and writes of the
+ *                             process, 0 (the default) for no limit
+ *   HDFS_LOCAL_BLOCK_SIZE     block size reported by stat and getHosts
+ *   HDFS_LOCAL_OUTAGE         a local file; while it exists every NameNode
+ *                             operation, read and write fails with
+ *                             ECONNRESET
+ *
+ * Names are returned as hdfs://host:port/path like a real NameNode would,
+ * and every block is reported on "localhost".
+ */
+
+#define _XOPEN_SOURCE 700
+#define _FILE_OFFSET_BITS 64
+
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <grp.h>
+#include <pwd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/statvfs.h>
+#include "hdfs.h"
+
+#define LOCAL_PATH_MAX 4096
+
+typedef struct {
+  char *host;
+  tPort port;
+  char *user;
+  char *cwd;
+} local_fs_t;
+
+typedef struct {
+  int fd;
+  tOffset pos;
+} local_file_t;
+
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static const char *local_root = "/tmp/hdfs-local";
+static double connect_ms = 0;
+static double latency_ms = 0;
+static double data_ms = 0;
+static double bandwidth = 0;          /* bytes per second */
+static tOffset block_size = 64 * 1024 * 1024;
+static const char *outage_file = NULL;
+
+static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static double link_free_at = 0;       /* when the simulated link is next idle */
+
+static double env_number(const char *name, double fallback)
+{
+  const char *value = getenv(name);
+  return value && *value ? atof(value) : fallback;
+}
+
+static void load_config(void)
+{
+  const char *root = getenv("HDFS_LOCAL_ROOT");
+  if(root && *root) local_root = root;
+  connect_ms = env_number("HDFS_LOCAL_CONNECT_MS", 0);
+  latency_ms = env_number("HDFS_LOCAL_LATENCY_MS", 0);
+  data_ms = env_number("HDFS_LOCAL_DATA_MS", 0);
+  bandwidth = env_number("HDFS_LOCAL_BANDWIDTH_MB", 0) * 1024 * 1024;
+  block_size = (tOffset) env_number("HDFS_LOCAL_BLOCK_SIZE", (double) block_size);
+  if(block_size <= 0) block_size = 64 * 1024 * 1024;
+  outage_file = getenv("HDFS_LOCAL_OUTAGE");
+  if(outage_file && !*outage_file) outage_file = NULL;
+}
+
+static double now_s(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void sleep_s(double seconds)
+{
+  struct timespec ts;
+  if(seconds <= 0) return;
+  ts.tv_sec = (time_t) seconds;
+  ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1e9);
+  while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+static int unreachable(void)
+{
+  if(!outage_file || access(outage_file, F_OK) == -1) return 0;
+  errno = ECONNRESET;
+  return 1;
+}
+
+/* -1 (ECONNRESET) when the NameNode is unreachable */
+static int rpc_delay(void)
+{
+  pthread_once(&config_once, load_config);
+  sleep_s(latency_ms / 1000);
+  return unreachable() ? -1 : 0;
+}
+
+/* per-call latency, then the bytes queue on one link shared by all threads;
+ * -1 (ECONNRESET) when the DataNodes are unreachable */
+static int data_delay(tOffset bytes)
+{
+  double done;
+  pthread_once(&config_once, load_config);
+  sleep_s(data_ms / 1000);
+  if(unreachable()) return -1;
+  if(bandwidth <= 0 || bytes <= 0) return 0;
+
+  pthread_mutex_lock(&link_lock);
+  done = now_s();
+  if(link_free_at > done) done = link_free_at;
+  done += bytes / bandwidth;
+  link_free_at = done;
+  pthread_mutex_unlock(&link_lock);
+
+  sleep_s(done - now_s());
+  return 0;
+}
+
+/* "hdfs://host:port/a/b" or "a/b" (relative to the working directory) to
+ * the HDFS path, without trailing slashes */
+static void hdfs_path(local_fs_t *fs, const char *path, char *out)
+{
+  const char *scheme = strstr(path, "://");
+  size_t length;
+  if(scheme) {
+    path = strchr(scheme + 3, '/');
+    if(!path) path = "/";
+  }
+  if(path[0] == '/') {
+    snprintf(out, LOCAL_PATH_MAX, "%s", path);
+  } else {
+    snprintf(out, LOCAL_PATH_MAX, "%s/%s", strcmp(fs->cwd, "/") ? fs->cwd : "", path);
+  }
+  length = strlen(out);
+  while(length > 1 && out[length - 1] == '/') out[--length] = '\0';
+}
+
+static void local_path(local_fs_t *fs, const char *path, char *out)
+{
+  char hpath[LOCAL_PATH_MAX];
+  hdfs_path(fs, path, hpath);
+  snprintf(out, LOCAL_PATH_MAX, "%s%s", local_root, hpath);
+}
+
+static int make_dirs(const char *path)
+{
+  char buffer[LOCAL_PATH_MAX];
+  char *p;
+  snprintf(buffer, sizeof(buffer), "%s", path);
+  for(p = buffer + 1; *p; p++) {
+    if(*p != '/') continue;
+    *p = '\0';
+    if(mkdir(buffer, 0755) == -1 && errno != EEXIST) return -1;
+    *p = '/';
+  }
+  if(mkdir(buffer, 0755) == -1 && errno != EEXIST) return -1;
+  return 0;
+}
+
+static int make_parent(const char *path)
+{
+  char buffer[LOCAL_PATH_MAX];
+  char *slash;
+  snprintf(buffer, sizeof(buffer), "%s", path);
+  slash = strrchr(buffer, '/');
+  if(!slash || slash == buffer) return 0;
+  *slash = '\0';
+  return make_dirs(buffer);
+}
+
+static hdfsFS connect_fs(const char *host, tPort port, const char *user)
+{
+  local_fs_t *fs;
+  pthread_once(&config_once, load_config);
+  sleep_s(connect_ms / 1000);
+  if(make_dirs(local_root) == -1) return NULL;
+
+  fs = (local_fs_t *) malloc(sizeof(local_fs_t));
+  fs->host = strdup(host && strcmp(host, "default") ? host : "localhost");
+  fs->port = port ? port : 8020;
+  fs->user = user ? strdup(user) : NULL;
+  fs->cwd = strdup("/");
+  return fs;
+}
+
+hdfsFS hdfsConnectAsUser(const char* host, tPort port, const char *user)
+{
+  return connect_fs(host, port, user);
+}
+
+hdfsFS hdfsConnect(const char* host, tPort port)
+{
+  return connect_fs(host, port, NULL);
+}
+
+hdfsFS hdfsConnectAsUserNewInstance(const char* host, tPort port, const char *user)
+{
+  return connect_fs(host, port, user);
+}
+
+hdfsFS hdfsConnectNewInstance(const char* host, tPort port)
+{
+  return connect_fs(host, port, NULL);
+}
+
+hdfsFS hdfsConnectPath(const char* uri)
+{
+  char host[256] = "localhost";
+  int port = 0;
+  const char *scheme = uri ? strstr(uri, "://") : NULL;
+  if(scheme) sscanf(scheme + 3, "%255[^:/]:%d", host, &port);
+  return connect_fs(host, (tPort) port, NULL);
+}
+
+int hdfsDisconnect(hdfsFS fs)
+{
+  local_fs_t *local = (local_fs_t *) fs;
+  if(!local) return -1;
+  free(local->host);
+  free(local->user);
+  free(local->cwd);
+  free(local);
+  return 0;
+}
+
+hdfsFile hdfsOpenFile(hdfsFS fs, const char* path, int flags,
+                      int bufferSize, short replication, tSize blocksize)
+{
+  char lpath[LOCAL_PATH_MAX];
+  int accmode = flags & O_ACCMODE;
+  int openFlags;
+  int fd;
+  struct stat st;
+  local_file_t *local;
+  hdfsFile file;
+
+  if(rpc_delay() == -1) return NULL;
+  if(accmode == O_RDWR) {
+    errno = ENOTSUP;
+    return NULL;
+  }
+  local_path((local_fs_t *) fs, path, lpath);
+
+  if(accmode == O_WRONLY) {
+    openFlags = O_WRONLY | O_CREAT | ((flags & O_APPEND) ? O_APPEND : O_TRUNC);
+    if(make_parent(lpath) == -1) return NULL;
+  } else {
+    openFlags = O_RDONLY;
+  }
+
+  fd = open(lpath, openFlags, 0644);
+  if(fd == -1) return NULL;
+  if(fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+    close(fd);
+    errno = EISDIR;
+    return NULL;
+  }
+
+  local = (local_file_t *) malloc(sizeof(local_file_t));
+  local->fd = fd;
+  local->pos = (flags & O_APPEND) ? lseek(fd, 0, SEEK_END) : 0;
+
+  file = (hdfsFile) malloc(sizeof(struct hdfsFile_internal));
+  file->file = local;
+  file->type = accmode == O_WRONLY ? OUTPUT : INPUT;
+  return file;
+}
+
+int hdfsCloseFile(hdfsFS fs, hdfsFile file)
+{
+  local_file_t *local;
+  int ret;
+  if(!file) return -1;
+  rpc_delay();
+  local = (local_file_t *) file->file;
+  ret = close(local->fd);
+  free(local);
+  free(file);
+  return ret == 0 ? 0 : -1;
+}
+
+int hdfsExists(hdfsFS fs, const char *path)
+{
+  char lpath[LOCAL_PATH_MAX];
+  struct stat st;
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, path, lpath);
+  return stat(lpath, &st) == 0 ? 0 : -1;
+}
+
+int hdfsSeek(hdfsFS fs, hdfsFile file, tOffset desiredPos)
+{
+  if(!file || file->type != INPUT || desiredPos < 0) return -1;
+  ((local_file_t *) file->file)->pos = desiredPos;
+  return 0;
+}
+
+tOffset hdfsTell(hdfsFS fs, hdfsFile file)
+{
+  if(!file) return -1;
+  return ((local_file_t *) file->file)->pos;
+}
+
+tSize hdfsRead(hdfsFS fs, hdfsFile file, void* buffer, tSize length)
+{
+  local_file_t *local;
+  tSize n;
+  if(!file || file->type != INPUT) return -1;
+  local = (local_file_t *) file->file;
+  n = hdfsPread(fs, file, local->pos, buffer, length);
+  if(n > 0) local->pos += n;
+  return n;
+}
+
+tSize hdfsPread(hdfsFS fs, hdfsFile file, tOffset position, void* buffer, tSize length)
+{
+  ssize_t n;
+  if(!file || file->type != INPUT) return -1;
+  n = pread(((local_file_t *) file->file)->fd, buffer, length, position);
+  if(n < 0 || data_delay(n) == -1) return -1;
+  return (tSize) n;
+}
+
+tSize hdfsWrite(hdfsFS fs, hdfsFile file, const void* buffer, tSize length)
+{
+  local_file_t *local;
+  tSize total = 0;
+  if(!file || file->type != OUTPUT) return -1;
+  local = (local_file_t *) file->file;
+  if(data_delay(length) == -1) return -1;
+  while(total < length) {
+    ssize_t n = write(local->fd, (const char *) buffer + total, length - total);
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    total += n;
+  }
+  local->pos += total;
+  return total;
+}
+
+/* the data is in the page cache already, which is what hflush promises */
+int hdfsFlush(hdfsFS fs, hdfsFile file)
+{
+  if(!file || file->type != OUTPUT) return -1;
+  return 0;
+}
+
+int hdfsAvailable(hdfsFS fs, hdfsFile file)
+{
+  struct stat st;
+  local_file_t *local;
+  if(!file || file->type != INPUT) return -1;
+  local = (local_file_t *) file->file;
+  if(fstat(local->fd, &st) == -1) return -1;
+  return st.st_size > local->pos ? (int) (st.st_size - local->pos) : 0;
+}
+
+static int copy_file(const char *src, const char *dst)
+{
+  char buffer[64 * 1024];
+  int in, out;
+  ssize_t n = 0;
+
+  in = open(src, O_RDONLY);
+  if(in == -1) return -1;
+  out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(out == -1) {
+    close(in);
+    return -1;
+  }
+  while((n = read(in, buffer, sizeof(buffer))) > 0) {
+    if(data_delay(n) == -1 || write(out, buffer, n) != n) {
+      n = -1;
+      break;
+    }
+  }
+  close(in);
+  close(out);
+  return n < 0 ? -1 : 0;
+}
+
+static int copy_tree(const char *src, const char *dst)
+{
+  struct stat st;
+  DIR *dir;
+  struct dirent *entry;
+  int ret = 0;
+
+  if(stat(src, &st) == -1) return -1;
+  if(!S_ISDIR(st.st_mode)) return copy_file(src, dst);
+
+  if(make_dirs(dst) == -1) return -1;
+  dir = opendir(src);
+  if(!dir) return -1;
+  while(ret == 0 && (entry = readdir(dir))) {
+    char from[LOCAL_PATH_MAX], to[LOCAL_PATH_MAX];
+    if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+    snprintf(from, sizeof(from), "%s/%s", src, entry->d_name);
+    snprintf(to, sizeof(to), "%s/%s", dst, entry->d_name);
+    ret = copy_tree(from, to);
+  }
+  closedir(dir);
+  return ret;
+}
+
+/* like FileUtil.copy: a directory is copied whole, into dst when it exists */
+static int local_copy(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst, char *from, char *to)
+{
+  struct stat st;
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) srcFS, src, from);
+  local_path((local_fs_t *) dstFS, dst, to);
+  if(stat(to, &st) == 0 && S_ISDIR(st.st_mode)) {
+    const char *name = strrchr(from, '/');
+    size_t length = strlen(to);
+    snprintf(to + length, LOCAL_PATH_MAX - length, "%s", name ? name : "/");
+  }
+  if(make_parent(to) == -1) return -1;
+  return copy_tree(from, to);
+}
+
+int hdfsCopy(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
+{
+  char from[LOCAL_PATH_MAX], to[LOCAL_PATH_MAX];
+  return local_copy(srcFS, src, dstFS, dst, from, to);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+  return remove(path);
+}
+
+static int remove_tree(const char *path)
+{
+  return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int hdfsMove(hdfsFS srcFS, const char* src, hdfsFS dstFS, const char* dst)
+{
+  char from[LOCAL_PATH_MAX], to[LOCAL_PATH_MAX];
+  if(local_copy(srcFS, src, dstFS, dst, from, to) == -1) return -1;
+  return remove_tree(from) == 0 ? 0 : -1;
+}
+
+int hdfsDelete(hdfsFS fs, const char* path)
+{
+  char lpath[LOCAL_PATH_MAX];
+  struct stat st;
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, path, lpath);
+  if(lstat(lpath, &st) == -1) return -1;
+  return remove_tree(lpath) == 0 ? 0 : -1;
+}
+
+/* HDFS renames fail rather than overwrite, except into a directory */
+int hdfsRename(hdfsFS fs, const char* oldPath, const char* newPath)
+{
+  char from[LOCAL_PATH_MAX], to[LOCAL_PATH_MAX];
+  struct stat st;
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, oldPath, from);
+  local_path((local_fs_t *) fs, newPath, to);
+  if(stat(from, &st) == -1) return -1;
+  if(stat(to, &st) == 0) {
+    const char *name;
+    size_t length = strlen(to);
+    if(!S_ISDIR(st.st_mode)) return -1;
+    name = strrchr(from, '/');
+    snprintf(to + length, LOCAL_PATH_MAX - length, "%s", name ? name : "/");
+    if(stat(to, &st) == 0) return -1;
+  }
+  if(make_parent(to) == -1) return -1;
+  return rename(from, to) == 0 ? 0 : -1;
+}
+
+char* hdfsGetWorkingDirectory(hdfsFS fs, char *buffer, size_t bufferSize)
+{
+  local_fs_t *local = (local_fs_t *) fs;
+  if(strlen(local->cwd) >= bufferSize) return NULL;
+  strcpy(buffer, local->cwd);
+  return buffer;
+}
+
+int hdfsSetWorkingDirectory(hdfsFS fs, const char* path)
+{
+  local_fs_t *local = (local_fs_t *) fs;
+  char hpath[LOCAL_PATH_MAX];
+  hdfs_path(local, path, hpath);
+  free(local->cwd);
+  local->cwd = strdup(hpath);
+  return 0;
+}
+
+int hdfsCreateDirectory(hdfsFS fs, const char* path)
+{
+  char lpath[LOCAL_PATH_MAX];
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, path, lpath);
+  return make_dirs(lpath);
+}
+
+int hdfsSetReplication(hdfsFS fs, const char* path, int16_t replication)
+{
+  return hdfsExists(fs, path);
+}
+
+static char *user_name(uid_t uid)
+{
+  struct passwd *pw = getpwuid(uid);
+  char buffer[32];
+  if(pw) return strdup(pw->pw_name);
+  snprintf(buffer, sizeof(buffer), "%d", (int) uid);
+  return strdup(buffer);
+}
+
+static char *group_name(gid_t gid)
+{
+  struct group *gr = getgrgid(gid);
+  char buffer[32];
+  if(gr) return strdup(gr->gr_name);
+  snprintf(buffer, sizeof(buffer), "%d", (int) gid);
+  return strdup(buffer);
+}
+
+static int fill_info(local_fs_t *fs, const char *hpath, const char *lpath, hdfsFileInfo *info)
+{
+  struct stat st;
+  char name[LOCAL_PATH_MAX + 300];
+  if(stat(lpath, &st) == -1) return -1;
+
+  snprintf(name, sizeof(name), "hdfs://%s:%d%s", fs->host, (int) fs->port, hpath);
+  info->mKind = S_ISDIR(st.st_mode) ? kObjectKindDirectory : kObjectKindFile;
+  info->mName = strdup(name);
+  info->mLastMod = st.st_mtime;
+  info->mSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+  info->mReplication = S_ISDIR(st.st_mode) ? 0 : 1;
+  info->mBlockSize = S_ISDIR(st.st_mode) ? 0 : block_size;
+  info->mOwner = user_name(st.st_uid);
+  info->mGroup = group_name(st.st_gid);
+  info->mPermissions = st.st_mode & 0777;
+  info->mLastAccess = st.st_atime;
+  return 0;
+}
+
+/* like libhdfs, NULL (with numEntries 0) for an empty directory too */
+hdfsFileInfo *hdfsListDirectory(hdfsFS fs, const char* path, int *numEntries)
+{
+  local_fs_t *local = (local_fs_t *) fs;
+  char hpath[LOCAL_PATH_MAX], lpath[LOCAL_PATH_MAX];
+  hdfsFileInfo *infos = NULL;
+  int count = 0, capacity = 0;
+  DIR *dir;
+  struct dirent *entry;
+
+  *numEntries = 0;
+  if(rpc_delay() == -1) return NULL;
+  hdfs_path(local, path, hpath);
+  snprintf(lpath, sizeof(lpath), "%s%s", local_root, hpath);
+
+  dir = opendir(lpath);
+  if(!dir) return NULL;
+  while((entry = readdir(dir))) {
+    char childH[LOCAL_PATH_MAX + 256], childL[LOCAL_PATH_MAX + 256];
+    if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+    snprintf(childH, sizeof(childH), "%s/%s", strcmp(hpath, "/") ? hpath : "", entry->d_name);
+    snprintf(childL, sizeof(childL), "%s/%s", lpath, entry->d_name);
+    if(count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      infos = (hdfsFileInfo *) realloc(infos, capacity * sizeof(hdfsFileInfo));
+    }
+    if(fill_info(local, childH, childL, &infos[count]) == 0) count++;
+  }
+  closedir(dir);
+
+  if(count == 0) {
+    free(infos);
+    return NULL;
+  }
+  *numEntries = count;
+  return infos;
+}
+
+hdfsFileInfo *hdfsGetPathInfo(hdfsFS fs, const char* path)
+{
+  local_fs_t *local = (local_fs_t *) fs;
+  char hpath[LOCAL_PATH_MAX], lpath[LOCAL_PATH_MAX];
+  hdfsFileInfo *info;
+
+  if(rpc_delay() == -1) return NULL;
+  hdfs_path(local, path, hpath);
+  snprintf(lpath, sizeof(lpath), "%s%s", local_root, hpath);
+
+  info = (hdfsFileInfo *) malloc(sizeof(hdfsFileInfo));
+  if(fill_info(local, hpath, lpath, info) == -1) {
+    int error = errno;
+    free(info);
+    errno = error;
+    return NULL;
+  }
+  return info;
+}
+
+void hdfsFreeFileInfo(hdfsFileInfo *hdfsFileInfo, int numEntries)
+{
+  int i;
+  for(i = 0; i < numEntries; i++) {
+    free(hdfsFileInfo[i].mName);
+    free(hdfsFileInfo[i].mOwner);
+    free(hdfsFileInfo[i].mGroup);
+  }
+  free(hdfsFileInfo);
+}
+
+char*** hdfsGetHosts(hdfsFS fs, const char* path, tOffset start, tOffset length)
+{
+  hdfsFileInfo *info = hdfsGetPathInfo(fs, path);
+  char ***blocks;
+  tOffset first, last, i;
+
+  if(!info) return NULL;
+  if(info->mKind != kObjectKindFile || start < 0 || length <= 0 || start >= info->mSize) {
+    hdfsFreeFileInfo(info, 1);
+    return NULL;
+  }
+  if(start + length > info->mSize) length = info->mSize - start;
+  hdfsFreeFileInfo(info, 1);
+
+  first = start / block_size;
+  last = (start + length - 1) / block_size;
+  blocks = (char ***) malloc((last - first + 2) * sizeof(char **));
+  for(i = 0; i <= last - first; i++) {
+    blocks[i] = (char **) malloc(2 * sizeof(char *));
+    blocks[i][0] = strdup("localhost");
+    blocks[i][1] = NULL;
+  }
+  blocks[i] = NULL;
+  return blocks;
+}
+
+void hdfsFreeHosts(char ***blockHosts)
+{
+  int i, j;
+  for(i = 0; blockHosts[i]; i++) {
+    for(j = 0; blockHosts[i][j]; j++) free(blockHosts[i][j]);
+    free(blockHosts[i]);
+  }
+  free(blockHosts);
+}
+
+tOffset hdfsGetDefaultBlockSize(hdfsFS fs)
+{
+  pthread_once(&config_once, load_config);
+  return block_size;
+}
+
+tOffset hdfsGetCapacity(hdfsFS fs)
+{
+  struct statvfs st;
+  if(rpc_delay() == -1) return -1;
+  if(statvfs(local_root, &st) == -1) return -1;
+  return (tOffset) st.f_blocks * st.f_frsize;
+}
+
+tOffset hdfsGetUsed(hdfsFS fs)
+{
+  struct statvfs st;
+  if(rpc_delay() == -1) return -1;
+  if(statvfs(local_root, &st) == -1) return -1;
+  return (tOffset) (st.f_blocks - st.f_bfree) * st.f_frsize;
+}
+
+int hdfsChown(hdfsFS fs, const char* path, const char *owner, const char *group)
+{
+  return hdfsExists(fs, path);
+}
+
+int hdfsChmod(hdfsFS fs, const char* path, short mode)
+{
+  char lpath[LOCAL_PATH_MAX];
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, path, lpath);
+  return chmod(lpath, mode & 0777) == 0 ? 0 : -1;
+}
+
+int hdfsUtime(hdfsFS fs, const char* path, tTime mtime, tTime atime)
+{
+  char lpath[LOCAL_PATH_MAX];
+  struct stat st;
+  struct timeval times[2];
+  if(rpc_delay() == -1) return -1;
+  local_path((local_fs_t *) fs, path, lpath);
+  if(stat(lpath, &st) == -1) return -1;
+  times[0].tv_sec = atime ? atime : st.st_atime;
+  times[0].tv_usec = 0;
+  times[1].tv_sec = mtime ? mtime : st.st_mtime;
+  times[1].tv_usec = 0;
+  return utimes(lpath, times) == 0 ? 0 : -1;
+}
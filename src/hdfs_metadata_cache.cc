@@ -0,0 +1,254 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "hdfs_metadata_cache.h"
+
+static double cache_now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// "hdfs://host:port/a/b/" -> "/a/b"
+static std::string cache_key(const char *path)
+{
+  const char *scheme = strstr(path, "://");
+  if(scheme) {
+    path = strchr(scheme + 3, '/');
+    if(!path) path = "/";
+  }
+  std::string key(path);
+  while(key.size() > 1 && key[key.size() - 1] == '/') key.erase(key.size() - 1);
+  return key;
+}
+
+// malloc'ed like the arrays libhdfs returns, so hdfsFreeFileInfo frees them
+static hdfsFileInfo *cache_copy_infos(const hdfsFileInfo *src, int count)
+{
+  hdfsFileInfo *dst = (hdfsFileInfo *) malloc(sizeof(hdfsFileInfo) * (count > 0 ? count : 1));
+  for(int i=0; i<count; i++) {
+    dst[i] = src[i];
+    dst[i].mName = strdup(src[i].mName);
+    dst[i].mOwner = src[i].mOwner ? strdup(src[i].mOwner) : NULL;
+    dst[i].mGroup = src[i].mGroup ? strdup(src[i].mGroup) : NULL;
+  }
+  return dst;
+}
+
+HdfsMetadataCache::HdfsMetadataCache()
+{
+  pthread_mutex_init(&lock_, NULL);
+  ttl_ = 0;
+  maxEntries_ = 0;
+  size_ = 0;
+  generation_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+HdfsMetadataCache::~HdfsMetadataCache()
+{
+  Clear();
+  pthread_mutex_destroy(&lock_);
+}
+
+void HdfsMetadataCache::Configure(double ttl, int maxEntries)
+{
+  pthread_mutex_lock(&lock_);
+  ttl_ = ttl > 0 ? ttl : 0;
+  maxEntries_ = maxEntries > 0 ? maxEntries : 10000;
+  pthread_mutex_unlock(&lock_);
+
+  if(ttl <= 0) {
+    Clear();
+  } else {
+    pthread_mutex_lock(&lock_);
+    EvictOverflow();
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+bool HdfsMetadataCache::enabled()
+{
+  pthread_mutex_lock(&lock_);
+  bool enabled = ttl_ > 0;
+  pthread_mutex_unlock(&lock_);
+  return enabled;
+}
+
+bool HdfsMetadataCache::GetStat(const char *path, hdfsFileInfo **info)
+{
+  bool hit = false;
+  pthread_mutex_lock(&lock_);
+  if(ttl_ > 0) {
+    entry_map_t::iterator it = entries_.find(cache_key(path));
+    if(it != entries_.end() && it->second.statExpires > cache_now_ms()) {
+      *info = it->second.stat ? cache_copy_infos(it->second.stat, 1) : NULL;
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      hit = true;
+    }
+    hit ? stats_.hits++ : stats_.misses++;
+  }
+  pthread_mutex_unlock(&lock_);
+  return hit;
+}
+
+void HdfsMetadataCache::PutStat(const char *path, const hdfsFileInfo *info, unsigned long generation)
+{
+  pthread_mutex_lock(&lock_);
+  if(ttl_ > 0 && generation == generation_) {
+    entry_t &entry = Touch(cache_key(path))->second;
+    DropStat(entry);
+    entry.stat = info ? cache_copy_infos(info, 1) : NULL;
+    entry.statExpires = cache_now_ms() + ttl_;
+    size_++;
+    EvictOverflow();
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+bool HdfsMetadataCache::GetList(const char *path, hdfsFileInfo **list, int *count)
+{
+  bool hit = false;
+  pthread_mutex_lock(&lock_);
+  if(ttl_ > 0) {
+    entry_map_t::iterator it = entries_.find(cache_key(path));
+    if(it != entries_.end() && it->second.listExpires > cache_now_ms()) {
+      *list = cache_copy_infos(it->second.list, it->second.listCount);
+      *count = it->second.listCount;
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      hit = true;
+    }
+    hit ? stats_.hits++ : stats_.misses++;
+  }
+  pthread_mutex_unlock(&lock_);
+  return hit;
+}
+
+void HdfsMetadataCache::PutList(const char *path, const hdfsFileInfo *list, int count, unsigned long generation)
+{
+  pthread_mutex_lock(&lock_);
+  // a listing larger than the whole budget would only evict everything else
+  if(ttl_ > 0 && count < maxEntries_ && generation == generation_) {
+    entry_t &entry = Touch(cache_key(path))->second;
+    DropList(entry);
+    entry.list = cache_copy_infos(list, count);
+    entry.listCount = count;
+    entry.listExpires = cache_now_ms() + ttl_;
+    size_ += count;
+    EvictOverflow();
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+unsigned long HdfsMetadataCache::Generation()
+{
+  pthread_mutex_lock(&lock_);
+  unsigned long generation = generation_;
+  pthread_mutex_unlock(&lock_);
+  return generation;
+}
+
+// Creating or deleting a path changes what its ancestors contain (and mkdir
+// creates missing ancestors), and deleting or renaming a directory takes
+// its descendants with it.
+void HdfsMetadataCache::Invalidate(const char *path)
+{
+  std::string key = cache_key(path);
+
+  pthread_mutex_lock(&lock_);
+  generation_++;
+  if(!entries_.empty()) {
+    stats_.invalidations++;
+
+    std::string prefix = key == "/" ? key : key + "/";
+    entry_map_t::iterator it = entries_.lower_bound(prefix);
+    while(it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+      Erase(it++);
+    }
+
+    std::string ancestor = key;
+    while(true) {
+      it = entries_.find(ancestor);
+      if(it != entries_.end()) Erase(it);
+      if(ancestor == "/") break;
+      size_t slash = ancestor.rfind('/');
+      ancestor = slash == 0 || slash == std::string::npos ? "/" : ancestor.substr(0, slash);
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void HdfsMetadataCache::Clear()
+{
+  pthread_mutex_lock(&lock_);
+  generation_++;
+  while(!entries_.empty()) Erase(entries_.begin());
+  pthread_mutex_unlock(&lock_);
+}
+
+HdfsMetadataCache::cache_stats_t HdfsMetadataCache::Stats()
+{
+  pthread_mutex_lock(&lock_);
+  cache_stats_t stats = stats_;
+  stats.entries = size_;
+  pthread_mutex_unlock(&lock_);
+  return stats;
+}
+
+HdfsMetadataCache::entry_map_t::iterator HdfsMetadataCache::Touch(const std::string &key)
+{
+  entry_map_t::iterator it = entries_.find(key);
+  if(it != entries_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it;
+  }
+
+  entry_t entry;
+  entry.statExpires = 0;
+  entry.stat = NULL;
+  entry.listExpires = 0;
+  entry.list = NULL;
+  entry.listCount = 0;
+  lru_.push_front(key);
+  entry.lru = lru_.begin();
+  return entries_.insert(std::make_pair(key, entry)).first;
+}
+
+void HdfsMetadataCache::DropStat(entry_t &entry)
+{
+  if(entry.statExpires > 0) size_--;
+  if(entry.stat) hdfsFreeFileInfo(entry.stat, 1);
+  entry.stat = NULL;
+  entry.statExpires = 0;
+}
+
+void HdfsMetadataCache::DropList(entry_t &entry)
+{
+  if(entry.list) hdfsFreeFileInfo(entry.list, entry.listCount);
+  size_ -= entry.listCount;
+  entry.list = NULL;
+  entry.listCount = 0;
+  entry.listExpires = 0;
+}
+
+void HdfsMetadataCache::Erase(entry_map_t::iterator it)
+{
+  DropStat(it->second);
+  DropList(it->second);
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void HdfsMetadataCache::EvictOverflow()
+{
+  while(size_ > maxEntries_ && !lru_.empty()) {
+    Erase(entries_.find(lru_.back()));
+    stats_.evictions++;
+  }
+}
@@ -0,0 +1,85 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_METADATA_CACHE_H
+#define HDFS_METADATA_CACHE_H
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <string>
+#include "../vendor/hdfs.h"
+
+// Opt-in cache of hdfsGetPathInfo and hdfsListDirectory results, keyed by
+// path (without scheme and authority). Entries expire after ttl ms, and the
+// least recently used ones are evicted once more than maxEntries file infos
+// are held; a cached listing counts one per entry. Lookups that found
+// nothing are cached too, so exists() on a missing path is also served from
+// memory. Changes made through the owning client invalidate the path, its
+// descendants and its ancestors; changes made by anyone else are only seen
+// once the entry expires. Used from the worker threads, under lock.
+class HdfsMetadataCache
+{
+public:
+  struct cache_stats_t {
+    double hits;
+    double misses;
+    double evictions;
+    double invalidations;
+    int entries;
+  };
+
+  HdfsMetadataCache();
+  ~HdfsMetadataCache();
+
+  // ttl <= 0 disables the cache and drops everything in it
+  void Configure(double ttl, int maxEntries);
+  bool enabled();
+
+  // Results are copies allocated like libhdfs' own, so they are released
+  // with hdfsFreeFileInfo. GetStat returns true on a hit, with *info NULL
+  // when the path is known not to exist; a NULL info can be put likewise.
+  // A put passes the Generation() taken before the lookup it caches, and is
+  // dropped if anything was invalidated since: the result may predate it.
+  bool GetStat(const char *path, hdfsFileInfo **info);
+  void PutStat(const char *path, const hdfsFileInfo *info, unsigned long generation);
+  bool GetList(const char *path, hdfsFileInfo **list, int *count);
+  void PutList(const char *path, const hdfsFileInfo *list, int count, unsigned long generation);
+  unsigned long Generation();
+
+  void Invalidate(const char *path);
+  void Clear();
+
+  cache_stats_t Stats();
+
+private:
+  struct entry_t {
+    double statExpires;   // 0 when no stat is cached
+    hdfsFileInfo *stat;   // NULL for a cached miss
+    double listExpires;   // 0 when no listing is cached
+    hdfsFileInfo *list;
+    int listCount;
+    std::list<std::string>::iterator lru;
+  };
+
+  typedef std::map<std::string, entry_t> entry_map_t;
+
+  entry_map_t::iterator Touch(const std::string &key);
+  void DropStat(entry_t &entry);
+  void DropList(entry_t &entry);
+  void Erase(entry_map_t::iterator it);
+  void EvictOverflow();
+
+  pthread_mutex_t lock_;
+  double ttl_;
+  int maxEntries_;
+  int size_;
+  unsigned long generation_;   // bumped by every Invalidate and Clear
+  entry_map_t entries_;
+  std::list<std::string> lru_;   // most recently used first
+  cache_stats_t stats_;
+};
+
+#endif
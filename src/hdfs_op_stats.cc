@@ -0,0 +1,78 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <string.h>
+#include "hdfs_op_stats.h"
+
+HdfsOpStats &HdfsOpStats::Instance()
+{
+  static HdfsOpStats stats;
+  return stats;
+}
+
+HdfsOpStats::HdfsOpStats()
+{
+  slowThresholdUs_ = 0;
+  slow_ = NULL;
+}
+
+void HdfsOpStats::Record(const sample_t &sample)
+{
+  op_map_t::iterator it = ops_.find(sample.op);
+  if(it == ops_.end()) {
+    op_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    it = ops_.insert(std::make_pair(std::string(sample.op), stats)).first;
+  }
+
+  op_stats_t &stats = it->second;
+  stats.count++;
+  if(sample.failed) stats.errors++;
+  stats.bytes += sample.bytes;
+  Add(stats.queue, sample.queueUs);
+  Add(stats.service, sample.serviceUs);
+  Add(stats.loop, sample.loopUs);
+  Add(stats.callback, sample.callbackUs);
+
+  if(slow_ && sample.queueUs + sample.serviceUs + sample.loopUs + sample.callbackUs > slowThresholdUs_) slow_(sample);
+}
+
+void HdfsOpStats::Reset()
+{
+  ops_.clear();
+}
+
+void HdfsOpStats::SetSlowListener(double thresholdMs, slow_fn fn)
+{
+  slowThresholdUs_ = thresholdMs * 1000;
+  slow_ = fn;
+}
+
+void HdfsOpStats::Add(histogram_t &histogram, double us)
+{
+  if(us < 0) us = 0;
+  int bucket = 0;
+  while(bucket < BUCKETS - 1 && us >= (double)(2ULL << bucket)) bucket++;
+
+  histogram.count++;
+  histogram.totalUs += us;
+  if(us > histogram.maxUs) histogram.maxUs = us;
+  histogram.buckets[bucket]++;
+}
+
+double HdfsOpStats::histogram_t::Percentile(double p) const
+{
+  if(count == 0) return 0;
+  double wanted = p * count;
+  double seen = 0;
+  for(int i=0; i<BUCKETS; i++) {
+    seen += buckets[i];
+    if(seen >= wanted) {
+      double upper = (double)(2ULL << i);
+      return upper < maxUs ? upper : maxUs;
+    }
+  }
+  return maxUs;
+}
@@ -0,0 +1,78 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_OP_STATS_H
+#define HDFS_OP_STATS_H
+
+#include <map>
+#include <string>
+
+// Latency histograms and counters per operation ("open", "read", ...), fed
+// by the worker pool as each request completes. A request is timed in four
+// parts: waiting in its queue (thread pool starvation), running on a worker
+// thread (the libhdfs calls, NameNode and DataNode time), waiting for the
+// event loop to pick up the result (loop lag) and its callback on the main
+// thread. Samples are recorded and read on the main thread only, so nothing
+// here takes a lock.
+class HdfsOpStats
+{
+public:
+  // bucket i counts samples of [2^i, 2^(i+1)) microseconds, bucket 0 also < 1
+  static const int BUCKETS = 32;
+
+  struct histogram_t {
+    double count;
+    double totalUs;
+    double maxUs;
+    double buckets[BUCKETS];
+
+    // upper bound of the bucket holding the p-th fraction, capped by maxUs
+    double Percentile(double p) const;
+  };
+
+  struct op_stats_t {
+    double count;
+    double errors;
+    double bytes;
+    histogram_t queue;
+    histogram_t service;
+    histogram_t loop;
+    histogram_t callback;
+  };
+
+  struct sample_t {
+    const char *op;
+    double queueUs;
+    double serviceUs;
+    double loopUs;
+    double callbackUs;
+    double bytes;
+    bool failed;
+  };
+
+  typedef std::map<std::string, op_stats_t> op_map_t;
+  typedef void (*slow_fn)(const sample_t &sample);
+
+  static HdfsOpStats &Instance();
+
+  void Record(const sample_t &sample);
+  void Reset();
+
+  // fn is called for requests that took more than thresholdMs from submit
+  // to the end of their callback; NULL stops it
+  void SetSlowListener(double thresholdMs, slow_fn fn);
+
+  const op_map_t &ops() const { return ops_; }
+
+private:
+  HdfsOpStats();
+  static void Add(histogram_t &histogram, double us);
+
+  op_map_t ops_;
+  double slowThresholdUs_;
+  slow_fn slow_;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#include <sys/time.h>
+#include "hdfs_worker_pool.h"
+#include "hdfs_op_stats.h"
+
+static double worker_now_us()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+HdfsWorkerPool &HdfsWorkerPool::Instance()
+{
+  static HdfsWorkerPool pool;
+  return pool;
+}
+
+HdfsWorkerPool::HdfsWorkerPool()
+{
+  started_ = false;
+  pthread_mutex_init(&lock_, NULL);
+  for(int q=0; q<QUEUES; q++) {
+    pthread_cond_init(&queues_[q].ready, NULL);
+    queues_[q].wanted = 4;
+    queues_[q].active = 0;
+    queues_[q].completed = 0;
+  }
+}
+
+void HdfsWorkerPool::Configure(int metadataThreads, int dataThreads)
+{
+  pthread_mutex_lock(&lock_);
+  if(metadataThreads > 0) queues_[METADATA].wanted = metadataThreads;
+  if(dataThreads > 0) queues_[DATA].wanted = dataThreads;
+  pthread_mutex_unlock(&lock_);
+
+  if(started_) {
+    for(int q=0; q<QUEUES; q++) {
+      while((int)queues_[q].threads.size() < queues_[q].wanted) Spawn(q);
+    }
+  }
+}
+
+void HdfsWorkerPool::Start()
+{
+  started_ = true;
+
+  ev_async_init(&async_, Done);
+  ev_async_start(EV_DEFAULT_UC, &async_);
+  ev_unref(EV_DEFAULT_UC); // callers ev_ref() per request, like eio_custom users
+
+  for(int q=0; q<QUEUES; q++) {
+    while((int)queues_[q].threads.size() < queues_[q].wanted) Spawn(q);
+  }
+}
+
+void HdfsWorkerPool::Spawn(int queue)
+{
+  thread_arg_t *arg = new thread_arg_t();
+  arg->pool = this;
+  arg->queue = queue;
+
+  pthread_t thread;
+  if(pthread_create(&thread, NULL, Run, arg) == 0) {
+    pthread_detach(thread);
+    queues_[queue].threads.push_back(thread);
+  } else {
+    delete arg;
+  }
+}
+
+void HdfsWorkerPool::Submit(int queue, const char *op, hdfs_work_fn execute, hdfs_work_fn after, void *data)
+{
+  if(!started_) Start();
+
+  hdfs_work_t *req = new hdfs_work_t();
+  req->data = data;
+  req->queue = queue;
+  req->op = op;
+  req->execute = execute;
+  req->after = after;
+  req->submitted = worker_now_us();
+  req->started = req->finished = req->submitted;
+  req->bytes = 0;
+  req->failed = false;
+
+  pthread_mutex_lock(&lock_);
+  queues_[queue].pending.push_back(req);
+  pthread_cond_signal(&queues_[queue].ready);
+  pthread_mutex_unlock(&lock_);
+}
+
+HdfsWorkerPool::queue_stats_t HdfsWorkerPool::Stats(int queue)
+{
+  queue_stats_t stats;
+  pthread_mutex_lock(&lock_);
+  stats.threads = queues_[queue].threads.size();
+  stats.pending = queues_[queue].pending.size();
+  stats.active = queues_[queue].active;
+  stats.completed = queues_[queue].completed;
+  pthread_mutex_unlock(&lock_);
+  return stats;
+}
+
+void *HdfsWorkerPool::Run(void *arg)
+{
+  thread_arg_t *threadArg = static_cast<thread_arg_t*>(arg);
+  HdfsWorkerPool *pool = threadArg->pool;
+  queue_t &queue = pool->queues_[threadArg->queue];
+  delete threadArg;
+
+  for(;;) {
+    pthread_mutex_lock(&pool->lock_);
+    while(queue.pending.empty()) pthread_cond_wait(&queue.ready, &pool->lock_);
+    hdfs_work_t *req = queue.pending.front();
+    queue.pending.pop_front();
+    queue.active++;
+    pthread_mutex_unlock(&pool->lock_);
+
+    req->started = worker_now_us();
+    req->execute(req);
+    req->finished = worker_now_us();
+
+    pthread_mutex_lock(&pool->lock_);
+    queue.active--;
+    queue.completed++;
+    pool->done_.push_back(req);
+    pthread_mutex_unlock(&pool->lock_);
+
+    ev_async_send(EV_DEFAULT_UC, &pool->async_);
+  }
+  return NULL;
+}
+
+// ev_async sends coalesce, so drain everything that completed
+void HdfsWorkerPool::Done(EV_P_ ev_async *watcher, int revents)
+{
+  HdfsWorkerPool &pool = Instance();
+  std::deque<hdfs_work_t*> done;
+
+  pthread_mutex_lock(&pool.lock_);
+  done.swap(pool.done_);
+  pthread_mutex_unlock(&pool.lock_);
+
+  for(size_t i=0; i<done.size(); i++) {
+    hdfs_work_t *req = done[i];
+    double callbackStart = worker_now_us();
+    req->after(req);
+
+    HdfsOpStats::sample_t sample;
+    sample.op = req->op;
+    sample.queueUs = req->started - req->submitted;
+    sample.serviceUs = req->finished - req->started;
+    sample.loopUs = callbackStart - req->finished;
+    sample.callbackUs = worker_now_us() - callbackStart;
+    sample.bytes = req->bytes;
+    sample.failed = req->failed;
+    HdfsOpStats::Instance().Record(sample);
+
+    delete req;
+  }
+}
@@ -0,0 +1,88 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+ * LICENSE file.
+ */
+
+#ifndef HDFS_WORKER_POOL_H
+#define HDFS_WORKER_POOL_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include <node.h>
+
+struct hdfs_work_t;
+typedef int (*hdfs_work_fn)(hdfs_work_t *req);
+
+// submitted/started/finished are stamped by the pool (microseconds); execute
+// sets bytes and failed, which go into HdfsOpStats under op with the timings
+struct hdfs_work_t {
+  void *data;
+  int queue;
+  const char *op;
+  hdfs_work_fn execute;  // on a worker thread
+  hdfs_work_fn after;    // back on the main thread
+  double submitted;
+  double started;
+  double finished;
+  double bytes;
+  bool failed;
+};
+
+// Threads dedicated to libhdfs calls, so slow NameNode RPCs and long preads
+// do not compete with node's own fs work in the libeio pool. Metadata
+// operations and bulk data transfers have separate queues served by
+// separate threads, so a large export cannot starve stat/list calls. The
+// threads live as long as the process, so libhdfs attaches each one to the
+// JVM once instead of on every new eio thread.
+class HdfsWorkerPool
+{
+public:
+  enum { METADATA = 0, DATA = 1, QUEUES = 2 };
+
+  struct queue_stats_t {
+    int threads;
+    int pending;
+    int active;
+    double completed;
+  };
+
+  static HdfsWorkerPool &Instance();
+
+  // Sets the number of threads per queue. Threads already running are kept,
+  // so a running pool can grow but not shrink.
+  void Configure(int metadataThreads, int dataThreads);
+
+  // main thread
+  void Submit(int queue, const char *op, hdfs_work_fn execute, hdfs_work_fn after, void *data);
+  queue_stats_t Stats(int queue);
+
+private:
+  struct queue_t {
+    std::deque<hdfs_work_t*> pending;
+    pthread_cond_t ready;
+    std::vector<pthread_t> threads;
+    int wanted;
+    int active;
+    double completed;
+  };
+
+  struct thread_arg_t {
+    HdfsWorkerPool *pool;
+    int queue;
+  };
+
+  HdfsWorkerPool();
+  void Start();
+  void Spawn(int queue);
+  static void *Run(void *arg);
+  static void Done(EV_P_ ev_async *watcher, int revents);
+
+  bool started_;
+  pthread_mutex_t lock_;
+  queue_t queues_[QUEUES];
+  std::deque<hdfs_work_t*> done_;
+  ev_async async_;
+};
+
+#endif
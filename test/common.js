@@ -0,0 +1,66 @@
+// Setup shared by the tests in this directory. They run against the local
+// libhdfs stand-in (node-waf configure --hdfs-local build), which keeps HDFS
+// paths as files under $HDFS_LOCAL_ROOT, so fixtures are written and checked
+// there directly with fs. Each test file works in a directory of its own,
+// emptied before it starts.
+
+var fs    = require('fs')
+  , path  = require('path')
+  , exec  = require('child_process').exec
+  , HDFS  = require('../node-hdfs');
+
+var root = process.env.HDFS_LOCAL_ROOT || "/tmp/hdfs-local";
+var name = path.basename(process.argv[1], ".js");
+var finished = false;
+
+exports.HDFS = HDFS;
+exports.client = new HDFS({host: "default", port: 0});
+exports.dir = "/node-hdfs-test/" + name;
+
+// local file behind an HDFS path
+exports.local = function(hdfsPath) {
+  return root + hdfsPath;
+}
+
+exports.setup = function(cb) {
+  var dir = exports.local(exports.dir);
+  exec("rm -rf '" + dir + "' && mkdir -p '" + dir + "'", function(err) {
+    if(err) throw err;
+    cb();
+  });
+}
+
+// bytes that differ from one offset to the next, so misplaced data shows
+exports.pattern = function(length, seed) {
+  var buffer = new Buffer(length);
+  for(var i = 0; i < length; i++) buffer[i] = (i * 31 + (seed || 0) + (i >> 8)) & 255;
+  return buffer;
+}
+
+exports.equalBytes = function(actual, expected, message) {
+  if(actual.length != expected.length || actual.toString("hex") != expected.toString("hex")) {
+    throw new Error((message || "bytes differ") + ": got " + actual.length + " bytes, expected " + expected.length);
+  }
+}
+
+// runs fn(item, next) over items one at a time, then cb()
+exports.series = function(items, fn, cb) {
+  var next = function(i) {
+    if(i == items.length) return cb();
+    fn(items[i], function() { next(i + 1); });
+  };
+  next(0);
+}
+
+// A test that exits without calling done() lost a callback somewhere.
+exports.done = function() {
+  finished = true;
+  exports.client.disconnect();
+  process.exit(0);
+}
+
+process.on("exit", function(code) {
+  if(finished || code) return;
+  console.error(name + ": exited before the test finished");
+  process.reallyExit(1);
+});
@@ -0,0 +1,58 @@
+// Runs every test/test-*.js (or the ones named on the command line) in a
+// process of its own and reports which failed. The addon must be built with
+// the local libhdfs stand-in; npm test does that first:
+//
+//   node-waf configure --hdfs-local build && node test/run.js [name ...]
+//
+// HDFS_LOCAL_ROOT defaults to /tmp/node-hdfs-test here, and the stand-in
+// reports 1 MB blocks so that block boundaries are cheap to cross.
+
+var fs    = require('fs')
+  , path  = require('path')
+  , spawn = require('child_process').spawn;
+
+var TIMEOUT_MS = 120000;
+
+var names = process.argv.slice(2);
+var tests = fs.readdirSync(__dirname).filter(function(file) {
+  if(!/^test-.*\.js$/.test(file)) return false;
+  return names.length == 0 || names.some(function(name) { return file.indexOf(name) >= 0; });
+}).sort();
+
+var env = {};
+for(var key in process.env) env[key] = process.env[key];
+env.HDFS_LOCAL_ROOT = env.HDFS_LOCAL_ROOT || "/tmp/node-hdfs-test";
+env.HDFS_LOCAL_BLOCK_SIZE = env.HDFS_LOCAL_BLOCK_SIZE || String(1024 * 1024);
+
+var failed = [];
+
+var run = function(i) {
+  if(i == tests.length) {
+    console.log(failed.length ? failed.length + " of " + tests.length + " failed: " + failed.join(", ")
+                              : "all " + tests.length + " passed");
+    process.exit(failed.length ? 1 : 0);
+  }
+
+  var test = tests[i], started = Date.now(), output = "";
+  var child = spawn(process.execPath, [path.join(__dirname, test)], {env: env});
+  var timer = setTimeout(function() {
+    output += "killed after " + TIMEOUT_MS + " ms\n";
+    child.kill();
+  }, TIMEOUT_MS);
+
+  child.stdout.on("data", function(data) { output += data; });
+  child.stderr.on("data", function(data) { output += data; });
+  child.on("exit", function(code) {
+    clearTimeout(timer);
+    if(code === 0) {
+      console.log("ok   " + test + " (" + (Date.now() - started) + " ms)");
+    } else {
+      failed.push(test);
+      console.log("FAIL " + test);
+      process.stdout.write(output.replace(/^/gm, "     "));
+    }
+    run(i + 1);
+  });
+}
+
+run(0);
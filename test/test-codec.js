@@ -0,0 +1,53 @@
+// gzip files are written and read back through the codec, from the start
+// only; data that does not inflate fails the read.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var lines = [];
+for(var i = 0; i < 20000; i++) lines.push("line " + i);
+var DATA = new Buffer(lines.join("\n"));
+
+var readAll = function(file, options, cb) {
+  var chunks = [], length = 0;
+  var reader = client.read(file, options);
+  reader.on("data", function(data) { chunks.push(new Buffer(data)); length += data.length; });
+  reader.on("end", function(err) {
+    var result = new Buffer(length), at = 0;
+    chunks.forEach(function(chunk) { chunk.copy(result, at); at += chunk.length; });
+    cb(err, result);
+  });
+}
+
+common.setup(function() {
+  var file = common.dir + "/data.gz", plain = common.dir + "/plain";
+  fs.writeFileSync(common.local(plain), DATA);
+
+  client.write(file, {codec: "gzip"}, function(writter) {
+    writter.once("open", function(err) {
+      assert.ifError(err);
+      writter.write(DATA.slice(0, 100000));
+      writter.end(DATA.slice(100000));
+    });
+    writter.once("close", function(err) {
+      assert.ifError(err);
+      assert.ok(fs.statSync(common.local(file)).size < DATA.length, "the file is compressed");
+
+      readAll(file, {codec: "gzip", bufferSize: 65536}, function(err, data) {
+        assert.ifError(err);
+        common.equalBytes(data, DATA, "inflated data");
+
+        assert.throws(function() {
+          client.read(file, {codec: "gzip", start: 1000});
+        }, /start cannot be used with a codec/);
+
+        readAll(plain, {codec: "gzip"}, function(err, data) {
+          assert.equal(err, "Corrupt gzip stream");
+          common.done();
+        });
+      });
+    });
+  });
+});
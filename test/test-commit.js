@@ -0,0 +1,99 @@
+// rename never overwrites, and commitDirectory publishes all of the staged
+// files or, when one rename fails, puts back the ones already moved.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , exec   = require('child_process').exec
+  , common = require('./common');
+
+var client = common.client;
+var dir = common.dir;
+
+var touch = function(hdfsPath, content) {
+  fs.writeFileSync(common.local(hdfsPath), content || hdfsPath);
+}
+
+var names = function(hdfsPath) {
+  return fs.readdirSync(common.local(hdfsPath)).sort();
+}
+
+var stage = function(staging) {
+  fs.mkdirSync(common.local(staging));
+  fs.mkdirSync(common.local(staging + "/_temporary"));
+  for(var i = 0; i < 5; i++) touch(staging + "/part-" + i);
+}
+
+var renames = function(next) {
+  touch(dir + "/a");
+  touch(dir + "/b", "b");
+  client.rename(dir + "/a", dir + "/b", function(err, ok) {
+    assert.equal(err, "Destination already exists");
+    assert.equal(ok, false);
+    assert.equal(fs.readFileSync(common.local(dir + "/b"), "utf8"), "b", "the destination is left alone");
+    assert.ok(fs.existsSync(common.local(dir + "/a")));
+
+    fs.mkdirSync(common.local(dir + "/into"));
+    client.rename(dir + "/a", dir + "/into", function(err, ok) {
+      assert.ifError(err);
+      assert.equal(ok, true);
+      assert.deepEqual(names(dir + "/into"), ["a"], "renaming onto a directory moves into it");
+      assert.ok(!fs.existsSync(common.local(dir + "/a")));
+      next();
+    });
+  });
+}
+
+var commit = function(next) {
+  var staging = dir + "/staging", target = dir + "/output";
+  stage(staging);
+  client.commitDirectory(staging, target, function(err, committed) {
+    assert.ifError(err);
+    assert.deepEqual(committed.sort(), [0, 1, 2, 3, 4].map(function(i) { return target + "/part-" + i; }));
+    assert.deepEqual(names(target), ["_SUCCESS", "part-0", "part-1", "part-2", "part-3", "part-4"]);
+    assert.equal(fs.readFileSync(common.local(target + "/part-2"), "utf8"), staging + "/part-2");
+    assert.ok(!fs.existsSync(common.local(staging)), "staging is removed");
+    next();
+  });
+}
+
+// the staging directory is removed even where rm would refuse it
+var firstLevel = function(next) {
+  var staging = "/" + common.dir.split("/").pop() + "-staging", target = dir + "/output3";
+  exec("rm -rf '" + common.local(staging) + "'", function(err) {
+    if(err) throw err;
+    stage(staging);
+    client.commitDirectory(staging, target, function(err, committed) {
+      assert.ifError(err);
+      assert.equal(committed.length, 5);
+      assert.ok(fs.existsSync(common.local(target + "/_SUCCESS")));
+      assert.ok(!fs.existsSync(common.local(staging)), "a first-level staging directory is removed");
+      next();
+    });
+  });
+}
+
+var rollback = function(next) {
+  var staging = dir + "/staging2", target = dir + "/output2";
+  stage(staging);
+  fs.mkdirSync(common.local(target));
+  touch(target + "/part-3", "existing");
+
+  client.commitDirectory(staging, target, {parallel: 2}, function(errors, committed) {
+    assert.ok(errors, "a clashing rename fails the commit");
+    var failed = Object.keys(errors);
+    assert.equal(failed.length, 1, "only part-3 fails: " + JSON.stringify(errors));
+    assert.ok(/\/part-3$/.test(failed[0]), failed[0]);
+    assert.equal(errors[failed[0]], "Destination already exists");
+    assert.deepEqual(committed, []);
+
+    assert.deepEqual(names(target), ["part-3"], "the renames done are undone, no _SUCCESS");
+    assert.equal(fs.readFileSync(common.local(target + "/part-3"), "utf8"), "existing");
+    assert.deepEqual(names(staging), ["_temporary", "part-0", "part-1", "part-2", "part-3", "part-4"]);
+    assert.equal(fs.readFileSync(common.local(staging + "/part-0"), "utf8"), staging + "/part-0");
+    next();
+  });
+}
+
+common.setup(function() {
+  common.series([renames, commit, firstLevel, rollback], function(step, next) { step(next); }, common.done);
+});
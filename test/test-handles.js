@@ -0,0 +1,70 @@
+// File handles are checked against the generation of their slot: a closed
+// handle is rejected, also once another open reuses the slot, and close
+// waits for the operations already issued on the handle.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var O_RDONLY = 0;
+var CHUNK = 4096, READS = 16;
+
+var invalid = function(fn) {
+  assert.throws(fn, /Invalid file handle/);
+}
+
+common.setup(function() {
+  var a = common.dir + "/a", b = common.dir + "/b";
+  var data = common.pattern(READS * CHUNK * 4);
+  fs.writeFileSync(common.local(a), data);
+  fs.writeFileSync(common.local(b), "bbbb");
+
+  client.open(a, O_RDONLY, function(err, first) {
+    assert.ifError(err);
+
+    var reads = 0;
+    for(var i = 0; i < READS; i++) (function(offset) {
+      var buffer = new Buffer(CHUNK);
+      client.readInto(first, offset, buffer, 0, CHUNK, function(err, readBytes) {
+        assert.ifError(err);
+        assert.equal(readBytes, CHUNK);
+        common.equalBytes(buffer, data.slice(offset, offset + CHUNK), "read at " + offset);
+        reads++;
+      });
+    })(i * CHUNK * 4);
+
+    client.close(first, function(err) {
+      assert.ifError(err);
+      assert.equal(reads, READS, "close called back before the reads issued ahead of it");
+
+      client.close(first, function(err) {
+        assert.equal(err, "Invalid file handle");
+        assert.equal(client.fileStats(first), undefined);
+
+        client.open(b, O_RDONLY, function(err, second) {
+          assert.ifError(err);
+          assert.notEqual(second, first);
+          assert.equal(client.fileStats(second).path, b);
+          assert.equal(client.fileStats(first), undefined);
+          invalid(function() { client.seek(first, 0, function() {}); });
+
+          var buffer = new Buffer(4);
+          client.readInto(second, 0, buffer, 0, 4, function(err, readBytes) {
+            assert.ifError(err);
+            assert.equal(buffer.toString(), "bbbb");
+            client.close(second, function(err) {
+              assert.ifError(err);
+              invalid(function() { client.tell(second, function() {}); });
+              common.done();
+            });
+          });
+        });
+      });
+    });
+
+    // closing: the reads above still run, new operations are refused
+    invalid(function() { client.readInto(first, 0, new Buffer(1), 0, 1, function() {}); });
+    invalid(function() { client.readv(first, [[0, 1]], function() {}); });
+  });
+});
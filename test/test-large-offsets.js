@@ -0,0 +1,168 @@
+// Offsets past 2 GB and 4 GB go through every read path unchanged: a sparse
+// file of 5 GB (a few KB on disk) holds markers straddling 2^31 and 2^32,
+// and everything else reads as zeros.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var O_RDONLY = 0;
+var GB = 1024 * 1024 * 1024;
+var SIZE = 5 * GB;
+var BLOCK_SIZE = parseInt(process.env.HDFS_LOCAL_BLOCK_SIZE, 10) || 1024 * 1024;
+
+var file = common.dir + "/sparse";
+var markers = [
+  {offset: 2 * GB - 8, data: common.pattern(16, 1)},           // across 2^31
+  {offset: 3 * GB, data: common.pattern(16, 2)},
+  {offset: 4 * GB - 4, data: common.pattern(16, 3)},           // across 2^32
+  {offset: 4 * GB + 16, data: common.pattern(16, 4)},
+  {offset: SIZE - 100000, data: common.pattern(4096, 5)},
+  {offset: SIZE - 16, data: common.pattern(16, 6)}             // sets the size
+];
+
+var TEXT_OFFSET = 4 * GB + 4096;
+var lines = [];
+for(var i = 0; i < 100; i++) lines.push("line" + i);
+markers.push({offset: TEXT_OFFSET, data: new Buffer(lines.join("\n") + "\n")});
+
+// what the file holds in [offset, offset + length), cut at the end of it
+var expected = function(offset, length) {
+  length = Math.max(Math.min(length, SIZE - offset), 0);
+  var buffer = new Buffer(length);
+  buffer.fill(0);
+  markers.forEach(function(marker) {
+    var from = Math.max(marker.offset, offset), to = Math.min(marker.offset + marker.data.length, offset + length);
+    if(from < to) marker.data.copy(buffer, from - offset, from - marker.offset, to - marker.offset);
+  });
+  return buffer;
+}
+
+var concat = function(buffers) {
+  var length = 0, at = 0;
+  buffers.forEach(function(buffer) { length += buffer.length; });
+  var result = new Buffer(length);
+  buffers.forEach(function(buffer) { buffer.copy(result, at); at += buffer.length; });
+  return result;
+}
+
+var stat = function(next) {
+  client.stat(file, function(err, info) {
+    assert.ifError(err);
+    assert.equal(info.size, SIZE);
+    next();
+  });
+}
+
+var readInto = function(next) {
+  client.open(file, O_RDONLY, function(err, handle) {
+    assert.ifError(err);
+    var ranges = [[2 * GB - 20, 40], [3 * GB - 1, 18], [4 * GB - 10, 40], [SIZE - 10, 10]];
+    common.series(ranges, function(range, done) {
+      var buffer = new Buffer(range[1] + 8);
+      buffer.fill(255);
+      client.readInto(handle, range[0], buffer, 8, range[1], function(err, readBytes) {
+        assert.ifError(err);
+        assert.equal(readBytes, range[1], "readInto at " + range[0]);
+        common.equalBytes(buffer.slice(8), expected(range[0], range[1]), "readInto at " + range[0]);
+        done();
+      });
+    }, function() {
+      var buffer = new Buffer(32);
+      client.readInto(handle, SIZE - 16, buffer, 0, 32, function(err, readBytes) {
+        assert.ifError(err);
+        assert.equal(readBytes, 16, "short at the end of the file");
+        common.equalBytes(buffer.slice(0, 16), markers[5].data, "last bytes");
+        client.close(handle, next);
+      });
+    });
+  });
+}
+
+var readv = function(next) {
+  client.open(file, O_RDONLY, function(err, handle) {
+    assert.ifError(err);
+    var ranges = [[4 * GB - 4, 16], [2 * GB - 8, 16], [3 * GB, 16], [4 * GB + 16, 16], [SIZE - 16, 32], [2 * GB - 1, 2]];
+    client.readv(handle, ranges, function(err, buffers) {
+      assert.ifError(err);
+      assert.equal(buffers.length, ranges.length);
+      ranges.forEach(function(range, i) {
+        common.equalBytes(buffers[i], expected(range[0], range[1]), "readv range " + i);
+      });
+      client.close(handle, next);
+    });
+  });
+}
+
+var seekTell = function(next) {
+  client.open(file, O_RDONLY, function(err, handle) {
+    assert.ifError(err);
+    client.seek(handle, 4 * GB + 16, function(err) {
+      assert.ifError(err);
+      client.tell(handle, function(err, offset) {
+        assert.ifError(err);
+        assert.equal(offset, 4 * GB + 16);
+        client.close(handle, next);
+      });
+    });
+  });
+}
+
+var blockLocations = function(next) {
+  client.blockLocations(file, 4 * GB + 1, 10, function(err, blocks) {
+    assert.ifError(err);
+    assert.equal(blocks.length, 1);
+    assert.equal(blocks[0].offset, 4 * GB);
+    assert.equal(blocks[0].length, BLOCK_SIZE);
+
+    client.blockLocations(file, 2 * GB - 1, 2, function(err, blocks) {
+      assert.ifError(err);
+      assert.deepEqual(blocks.map(function(block) { return block.offset; }), [2 * GB - BLOCK_SIZE, 2 * GB]);
+
+      client.blockLocations(file, SIZE - 1, 0, function(err, blocks) {
+        assert.ifError(err);
+        assert.equal(blocks.length, 1);
+        assert.equal(blocks[0].offset + blocks[0].length, SIZE);
+        next();
+      });
+    });
+  });
+}
+
+var stream = function(next) {
+  var start = SIZE - 3 * 65536 - 5;
+  var chunks = [];
+  var reader = client.read(file, {start: start, bufferSize: 65536});
+  reader.on("data", function(data) { chunks.push(new Buffer(data)); });
+  reader.on("end", function(err) {
+    assert.ifError(err);
+    common.equalBytes(concat(chunks), expected(start, SIZE - start), "stream from " + start);
+    next();
+  });
+}
+
+var records = function(next) {
+  var lineStart = function(i) { return TEXT_OFFSET + Buffer.byteLength(lines.slice(0, i).join("\n") + (i ? "\n" : "")); };
+  var got = [];
+  var reader = client.readRecords(file, {start: TEXT_OFFSET + 2, end: lineStart(50), bufferSize: 1024});
+  reader.on("records", function(batch) {
+    for(var i = 0; i < batch.length; i++) got.push(batch.toString(i));
+  });
+  reader.on("end", function(err) {
+    assert.ifError(err);
+    assert.deepEqual(got, lines.slice(1, 51), "the split holds lines 1 to 50");
+    next();
+  });
+}
+
+common.setup(function() {
+  var fd = fs.openSync(common.local(file), "w");
+  markers.forEach(function(marker) {
+    fs.writeSync(fd, marker.data, 0, marker.data.length, marker.offset);
+  });
+  fs.closeSync(fd);
+
+  common.series([stat, readInto, readv, seekTell, blockLocations, stream, records],
+                function(step, next) { step(next); }, common.done);
+});
@@ -0,0 +1,45 @@
+// A lookup that fails because the NameNode is unreachable is not cached as
+// "does not exist"; one that finds the path missing is, for the ttl.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var outage = common.local(common.dir + "/outage");
+// read by the stand-in on its first call
+process.env.HDFS_LOCAL_OUTAGE = outage;
+
+common.setup(function() {
+  var file = common.dir + "/file", missing = common.dir + "/missing";
+  fs.writeFileSync(common.local(file), "data");
+  client.configureMetadataCache({ttl: 60000});
+
+  fs.writeFileSync(outage, "");
+  client.stat(file, function(err, info) {
+    assert.ok(err, "stat fails while the NameNode is down");
+    client.exists(file, function(err, exists) {
+      assert.equal(exists, false);
+      fs.unlinkSync(outage);
+
+      client.stat(file, function(err, info) {
+        assert.ifError(err);
+        assert.equal(info.size, 4, "the failed lookup was not cached");
+        client.exists(file, function(err, exists) {
+          assert.equal(exists, true);
+
+          client.stat(missing, function(err) {
+            assert.equal(err, "File does not exist");
+            fs.writeFileSync(common.local(missing), "");
+            var hits = client.metadataCacheStats().hits;
+            client.stat(missing, function(err) {
+              assert.equal(err, "File does not exist", "a missing path is cached");
+              assert.equal(client.metadataCacheStats().hits, hits + 1);
+              common.done();
+            });
+          });
+        });
+      });
+    });
+  });
+});
@@ -0,0 +1,81 @@
+// planBlockReads places each block on a host holding a replica and spreads
+// the bytes; planReads feeds it the block locations of real files. The
+// stand-in reports every block on "localhost", in blocks of
+// $HDFS_LOCAL_BLOCK_SIZE (1 MB under run.js).
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var HDFS = common.HDFS;
+var client = common.client;
+var MB = 1024 * 1024;
+var BLOCK_SIZE = parseInt(process.env.HDFS_LOCAL_BLOCK_SIZE, 10) || MB;
+
+var sum = function(tasks) {
+  return tasks.reduce(function(total, task) { return total + task.length; }, 0);
+}
+
+var planning = function() {
+  var plan = HDFS.planBlockReads([
+    {path: "/a", offset: 0, length: 100, hosts: ["dn3"]},
+    {path: "/a", offset: 100, length: 100, hosts: ["DN1"]}
+  ], {workers: ["dn1", "dn2"]});
+  assert.equal(plan.tasks.length, 2);
+  var remote = plan.tasks.filter(function(task) { return task.offset == 0; })[0];
+  var local = plan.tasks.filter(function(task) { return task.offset == 100; })[0];
+  assert.equal(local.host, "dn1", "a block goes to the worker holding it");
+  assert.ok(local.local);
+  assert.ok(remote.host == "dn1" || remote.host == "dn2", "a block no worker holds still goes to a worker");
+  assert.ok(!remote.local);
+  assert.equal(plan.localBytes, 100);
+  assert.equal(plan.remoteBytes, 100);
+
+  plan = HDFS.planBlockReads([{path: "/b", offset: 1000, length: 100, hosts: ["dn1"]}], {taskSize: 30});
+  var pieces = plan.tasks.map(function(task) { return [task.offset, task.length]; });
+  pieces.sort(function(a, b) { return a[0] - b[0]; });
+  assert.deepEqual(pieces, [[1000, 30], [1030, 30], [1060, 30], [1090, 10]]);
+
+  var blocks = [];
+  for(var i = 0; i < 4; i++) blocks.push({path: "/c", offset: i * 100, length: 100, hosts: ["dn1", "dn2"]});
+  plan = HDFS.planBlockReads(blocks);
+  assert.equal(plan.byHost.dn1.length, 2, "replicated blocks are balanced");
+  assert.equal(plan.byHost.dn2.length, 2);
+  assert.equal(plan.localBytes, 400);
+}
+
+var files = function(next) {
+  var big = common.dir + "/big", small = common.dir + "/small", empty = common.dir + "/empty";
+  fs.writeFileSync(common.local(big), common.pattern(2.5 * BLOCK_SIZE));
+  fs.writeFileSync(common.local(small), common.pattern(BLOCK_SIZE));
+  fs.writeFileSync(common.local(empty), "");
+
+  client.planReads([big, small, common.dir + "/missing", empty], {parallel: 2}, function(errors, plan) {
+    assert.deepEqual(Object.keys(errors), [common.dir + "/missing"]);
+    assert.equal(errors[common.dir + "/missing"], "File does not exist");
+
+    assert.equal(plan.tasks.length, 4, "3 blocks of big, 1 of small, none of empty");
+    plan.tasks.forEach(function(task) {
+      assert.equal(task.host, "localhost");
+      assert.ok(task.local);
+    });
+    var bigTasks = plan.tasks.filter(function(task) { return task.path == big; });
+    bigTasks.sort(function(a, b) { return a.offset - b.offset; });
+    assert.deepEqual(bigTasks.map(function(task) { return [task.offset, task.length]; }),
+                     [[0, BLOCK_SIZE], [BLOCK_SIZE, BLOCK_SIZE], [2 * BLOCK_SIZE, BLOCK_SIZE / 2]]);
+    assert.equal(plan.localBytes, 3.5 * BLOCK_SIZE);
+    assert.equal(plan.remoteBytes, 0);
+    assert.equal(sum(plan.byHost.localhost), 3.5 * BLOCK_SIZE);
+
+    client.planReads([empty], function(errors, plan) {
+      assert.equal(errors, null);
+      assert.equal(plan.tasks.length, 0);
+      next();
+    });
+  });
+}
+
+common.setup(function() {
+  planning();
+  files(common.done);
+});
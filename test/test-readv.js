@@ -0,0 +1,84 @@
+// readv merges ranges closer than `gap` into one read and hands back each
+// requested range, in the order given, from one shared buffer.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var O_RDONLY = 0;
+var SIZE = 1024 * 1024;
+
+// total merged length for ranges sorted by offset, as the binding lays
+// them out in its buffer
+var mergedLength = function(ranges, gap) {
+  var sorted = ranges.slice().sort(function(a, b) { return a[0] - b[0]; });
+  var total = 0, start = -1, end = -1;
+  sorted.forEach(function(range) {
+    if(start >= 0 && range[0] <= end + gap) {
+      end = Math.max(end, range[0] + range[1]);
+    } else {
+      if(start >= 0) total += end - start;
+      start = range[0];
+      end = range[0] + range[1];
+    }
+  });
+  return start >= 0 ? total + end - start : 0;
+}
+
+var ranges = [
+  [1000, 100],
+  [1200, 50],
+  [0, 10],          // before the others: results still come back in this order
+  [5000, 0],
+  [1050, 100],      // overlaps [1000, 100]
+  [500000, 1000],
+  [SIZE - 10, 100]  // short at the end of the file
+];
+
+common.setup(function() {
+  var file = common.dir + "/data";
+  var data = common.pattern(SIZE);
+  fs.writeFileSync(common.local(file), data);
+
+  client.open(file, O_RDONLY, function(err, handle) {
+    assert.ifError(err);
+    var native = client.bindings();
+
+    var check = function(gap, next) {
+      native.readv(handle, ranges, {gap: gap, parallel: 2}, function(err, buffer, positions) {
+        assert.ifError(err);
+        assert.equal(buffer.length, mergedLength(ranges, gap), "merged length with gap " + gap);
+        assert.equal(positions.length, ranges.length);
+        ranges.forEach(function(range, i) {
+          var expected = data.slice(range[0], Math.min(range[0] + range[1], SIZE));
+          var got = buffer.slice(positions[i][0], positions[i][0] + positions[i][1]);
+          common.equalBytes(got, expected, "range " + i + " with gap " + gap);
+        });
+        next();
+      });
+    };
+
+    common.series([0, 150, 64 * 1024, SIZE], check, function() {
+      // the JS wrapper returns one slice per range
+      client.readv(handle, ranges, function(err, buffers) {
+        assert.ifError(err);
+        assert.equal(buffers.length, ranges.length);
+        assert.equal(buffers[6].length, 10);
+        assert.equal(buffers[3].length, 0);
+        common.equalBytes(buffers[2], data.slice(0, 10));
+
+        client.readv(handle, [], function(err, buffers) {
+          assert.ifError(err);
+          assert.equal(buffers.length, 0);
+          assert.throws(function() { client.readv(handle, [[-1, 10]], function() {}); }, RangeError);
+
+          client.close(handle, function(err) {
+            assert.ifError(err);
+            common.done();
+          });
+        });
+      });
+    });
+  });
+});
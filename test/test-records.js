@@ -0,0 +1,115 @@
+// Reading a file as splits [start, end) gives every record exactly once,
+// wherever the split boundaries fall: on a record start, on a delimiter,
+// inside one, or inside a record longer than the read buffer.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var BUFFER_SIZE = 1024;  // the smallest the binding allows
+
+// records of 0 to 89 bytes and some of 3000; empty ones are left out for a
+// multi-byte delimiter, where "||||" read from the middle is ambiguous
+var makeRecords = function(count, empty) {
+  var records = [];
+  for(var i = 0; i < count; i++) {
+    var length = i % 17 == 0 ? 0 : i % 41 == 0 ? 3000 : (i * 7) % 90;
+    if(!empty && length == 0) length = 1;
+    var record = "";
+    while(record.length < length) record += String.fromCharCode(97 + (record.length + i) % 26);
+    records.push(record);
+  }
+  return records;
+}
+
+// every offset around each record start, plus some in between
+var boundaries = function(records, delimiter, size) {
+  var offsets = {}, offset = 0;
+  records.forEach(function(record, i) {
+    if(i % 5 == 0) {
+      for(var d = -delimiter.length; d <= 1; d++) offsets[offset + d] = true;
+    }
+    if(record.length > 2000) offsets[offset + 1500] = true;
+    offset += record.length + delimiter.length;
+  });
+  return Object.keys(offsets).map(Number).filter(function(offset) {
+    return offset > 0 && offset < size;
+  }).sort(function(a, b) { return a - b; });
+}
+
+// reads the splits one after the other, cb(records of all of them)
+var readSplits = function(file, points, options, cb) {
+  var all = [];
+  var splits = [];
+  for(var i = 0; i + 1 < points.length; i++) splits.push([points[i], points[i + 1]]);
+
+  common.series(splits, function(split, next) {
+    var splitOptions = {start: split[0], end: split[1], bufferSize: BUFFER_SIZE};
+    for(var key in options) splitOptions[key] = options[key];
+    var reader = client.readRecords(file, splitOptions);
+    reader.on("records", function(batch) {
+      for(var i = 0; i < batch.length; i++) all.push(batch.toString(i));
+    });
+    reader.on("end", function(err) {
+      assert.ifError(err);
+      next();
+    });
+  }, function() {
+    cb(all);
+  });
+}
+
+var sameRecords = function(got, expected, message) {
+  assert.equal(got.length, expected.length, message + ": " + got.length + " records, expected " + expected.length);
+  for(var i = 0; i < expected.length; i++) {
+    assert.equal(got[i], expected[i], message + ": record " + i);
+  }
+}
+
+var delimited = function(name, delimiter, lineEnd, options) {
+  return function(next) {
+    var records = makeRecords(400, delimiter.length == 1);
+    var content = records.join(lineEnd) + (delimiter == "\n" ? lineEnd : "");
+    var file = common.dir + "/" + name;
+    fs.writeFileSync(common.local(file), content);
+    var size = Buffer.byteLength(content);
+
+    var points = [0].concat(boundaries(records, lineEnd, size), [size]);
+    readSplits(file, points, options, function(got) {
+      sameRecords(got, records, name + " split at every boundary");
+      readSplits(file, [0, size], options, function(got) {
+        sameRecords(got, records, name + " in one split");
+        next();
+      });
+    });
+  };
+}
+
+var fixed = function(next) {
+  var RECORD = 7;
+  var content = common.pattern(RECORD * 500 + 3).toString("hex");  // ends with a short record
+  var file = common.dir + "/fixed";
+  fs.writeFileSync(common.local(file), content);
+
+  var records = [];
+  for(var offset = 0; offset < content.length; offset += RECORD) records.push(content.substr(offset, RECORD));
+
+  var points = [0];
+  for(var point = 1; point < content.length; point += 97) points.push(point);
+  points.push(content.length);
+  readSplits(file, points, {recordLength: RECORD}, function(got) {
+    sameRecords(got, records, "fixed-length records");
+    next();
+  });
+}
+
+common.setup(function() {
+  var steps = [
+    delimited("lines", "\n", "\n"),
+    delimited("crlf", "\n", "\r\n"),
+    delimited("multibyte", "||", "||", {delimiter: "||"}),
+    fixed
+  ];
+  common.series(steps, function(step, next) { step(next); }, common.done);
+});
@@ -0,0 +1,82 @@
+// The write stream reports a failed write: what was queued is dropped, the
+// file is closed and "close" gets the error, instead of a "write" event
+// with a negative length.
+
+var assert = require('assert')
+  , fs     = require('fs')
+  , common = require('./common');
+
+var client = common.client;
+var CHUNK = 65536;
+var outage = common.local(common.dir + "/outage");
+// read by the stand-in on its first call
+process.env.HDFS_LOCAL_OUTAGE = outage;
+
+var writes = function(next) {
+  var file = common.dir + "/ok", data = common.pattern(3 * CHUNK);
+  client.write(file, {flush: "never"}, function(writter) {
+    writter.once("open", function(err) {
+      assert.ifError(err);
+      writter.write(data.slice(0, CHUNK));
+      writter.write(data.slice(CHUNK, 2 * CHUNK));
+      writter.flush(function(err) {
+        assert.ifError(err);
+        assert.equal(fs.statSync(common.local(file)).size, 2 * CHUNK, "flushed after the writes queued before it");
+        writter.end(data.slice(2 * CHUNK));
+      });
+    });
+    writter.once("close", function(err) {
+      assert.ifError(err);
+      common.equalBytes(fs.readFileSync(common.local(file)), data, "written data");
+      next();
+    });
+  });
+}
+
+var failedWrite = function(next) {
+  var file = common.dir + "/failed", data = common.pattern(CHUNK);
+  var written = [], flushed = false;
+  client.write(file, {flush: "never"}, function(writter) {
+    writter.on("write", function(len) { written.push(len); });
+    writter.once("open", function(err) {
+      assert.ifError(err);
+      fs.writeFileSync(outage, "");
+      writter.write(data);
+      writter.write(data);
+      writter.flush(function(err) {
+        assert.equal(err, "Error writing file");
+        flushed = true;
+      });
+    });
+    writter.once("close", function(err) {
+      fs.unlinkSync(outage);
+      assert.equal(err, "Error writing file");
+      assert.ok(flushed, "flush called back before close");
+      assert.deepEqual(written, [], "no write event for the failed write");
+      assert.equal(writter.write(data), false, "nothing is written after a failure");
+      next();
+    });
+  });
+}
+
+var failedUpload = function(next) {
+  var src = common.local(common.dir + "/upload.src"), size = 8 * CHUNK;
+  fs.writeFileSync(src, common.pattern(size));
+  var reported = 0;
+  var options = {bufferSize: CHUNK, onWrite: function(len) {
+    // the link goes down once the first chunk is in
+    if(reported == 0) fs.writeFileSync(outage, "");
+    reported += len;
+  }};
+  client.copyFromLocalPath(src, common.dir + "/upload", options, function(err, written) {
+    fs.unlinkSync(outage);
+    assert.equal(err, "Error writing file");
+    assert.equal(written, reported);
+    assert.ok(written > 0 && written < size, written + " of " + size + " bytes reported written");
+    next();
+  });
+}
+
+common.setup(function() {
+  common.series([writes, failedWrite, failedUpload], function(step, next) { step(next); }, common.done);
+});